@@ -0,0 +1,195 @@
+#ifndef SPACEPIX_CLUSTER_FINDER_HPP
+#define SPACEPIX_CLUSTER_FINDER_HPP
+
+/*
+Connected-component cluster finder for one frame of the Spacepix3
+pixel matrix (64 x 64 pixels, see spacepix3_model.conf).
+
+Pixels are 8-connected: two hit pixels belong to the same cluster if
+they touch at an edge or a corner. The frame is stored as one 64 bit
+occupancy mask per row, so each row splits into runs of adjacent hit
+pixels with a few bit operations. Runs that overlap (or touch
+diagonally) a run of the previous row are merged with union-find, and
+the cluster quantities are accumulated per run.
+
+The finder has no dependencies besides the standard library, so the
+same code can be used by the ROOT reader (OutputReader3.C), by the
+benchmark (cluster_benchmark.cpp) and in the real-time path. All
+buffers are reused between frames, find() does not allocate once they
+have grown to the largest frame seen.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+constexpr int spacepix_columns = 64;
+constexpr int spacepix_rows = 64;
+
+struct Cluster {
+	double x;          // charge-weighted centroid in pixel units
+	double y;
+	int size;          // number of pixels
+	int x_min;         // bounding box, inclusive
+	int x_max;
+	int y_min;
+	int y_max;
+	long long charge;  // total charge
+
+	int width() const { return x_max - x_min + 1; }
+	int height() const { return y_max - y_min + 1; }
+};
+
+
+class ClusterFinder {
+public:
+	ClusterFinder() : charge_map_(spacepix_columns * spacepix_rows, 0) {
+		std::fill(std::begin(rows_), std::end(rows_), 0);
+	}
+
+	// Finds the clusters of one frame given as n hits (pixel column x,
+	// pixel row y, charge). Hits outside the matrix are ignored, several
+	// hits on the same pixel add up. The result is valid until the next
+	// call.
+	const std::vector<Cluster>& find(const int* x, const int* y, const int* charge, size_t n) {
+		clusters_.clear();
+		runs_.clear();
+		parent_.clear();
+
+		// Occupancy mask and charge map of the frame
+		int y_lo = spacepix_rows, y_hi = -1;
+		for (size_t i = 0; i < n; i++) {
+			if (x[i] < 0 || x[i] >= spacepix_columns || y[i] < 0 || y[i] >= spacepix_rows) continue;
+			rows_[y[i]] |= uint64_t(1) << x[i];
+			charge_map_[y[i] * spacepix_columns + x[i]] += charge[i];
+			y_lo = std::min(y_lo, y[i]);
+			y_hi = std::max(y_hi, y[i]);
+		}
+
+		// Split rows into runs, and join each run with the runs of the
+		// previous row it touches
+		size_t prev_begin = 0, prev_end = 0;
+		for (int row = y_lo; row <= y_hi; row++) {
+			size_t begin = runs_.size();
+			uint64_t bits = rows_[row];
+			while (bits) {
+				int start = __builtin_ctzll(bits);
+				uint64_t shifted = bits >> start;
+				int length = (~shifted == 0) ? spacepix_columns - start : __builtin_ctzll(~shifted);
+				runs_.push_back({row, start, start + length - 1});
+				parent_.push_back(static_cast<int>(runs_.size() - 1));
+				bits &= (length + start >= 64) ? 0 : ~uint64_t(0) << (start + length);
+			}
+			size_t end = runs_.size();
+
+			// Both run lists are sorted by column, so one merge-like pass
+			// finds all touching pairs
+			if (prev_end > prev_begin && row == runs_[prev_begin].row + 1) {
+				size_t a = prev_begin, b = begin;
+				while (a < prev_end && b < end) {
+					if (runs_[a].end + 1 >= runs_[b].start && runs_[b].end + 1 >= runs_[a].start)
+						unite(a, b);
+					// Advance the run that ends first
+					if (runs_[a].end < runs_[b].end) a++;
+					else b++;
+				}
+			}
+			prev_begin = begin;
+			prev_end = end;
+		}
+
+		// Compact cluster indices and accumulate per run
+		label_.assign(runs_.size(), -1);
+		for (size_t r = 0; r < runs_.size(); r++) {
+			int root = root_of(r);
+			if (label_[root] < 0) {
+				label_[root] = static_cast<int>(clusters_.size());
+				clusters_.push_back({0., 0., 0, spacepix_columns, -1, spacepix_rows, -1, 0});
+				sums_.resize(clusters_.size());
+				sums_.back() = {};
+			}
+			int c = label_[root];
+			const Run& run = runs_[r];
+			Cluster& cluster = clusters_[c];
+			Sums& sum = sums_[c];
+
+			const int* q = &charge_map_[run.row * spacepix_columns];
+			for (int col = run.start; col <= run.end; col++) {
+				sum.q += q[col];
+				sum.qx += static_cast<double>(q[col]) * col;
+				sum.qy += static_cast<double>(q[col]) * run.row;
+				sum.x += col;
+			}
+			int length = run.end - run.start + 1;
+			sum.y += static_cast<double>(length) * run.row;
+			cluster.size += length;
+			cluster.x_min = std::min(cluster.x_min, run.start);
+			cluster.x_max = std::max(cluster.x_max, run.end);
+			cluster.y_min = std::min(cluster.y_min, run.row);
+			cluster.y_max = std::max(cluster.y_max, run.row);
+		}
+
+		for (size_t c = 0; c < clusters_.size(); c++) {
+			Cluster& cluster = clusters_[c];
+			const Sums& sum = sums_[c];
+			cluster.charge = sum.q;
+			// Fall back to the geometric centre if charges cancel out
+			if (sum.q > 0) {
+				cluster.x = sum.qx / sum.q;
+				cluster.y = sum.qy / sum.q;
+			} else {
+				cluster.x = sum.x / cluster.size;
+				cluster.y = sum.y / cluster.size;
+			}
+		}
+
+		// Leave the frame buffers empty for the next call
+		for (int row = y_lo; row <= y_hi; row++)
+			rows_[row] = 0;
+		for (size_t i = 0; i < n; i++) {
+			if (x[i] < 0 || x[i] >= spacepix_columns || y[i] < 0 || y[i] >= spacepix_rows) continue;
+			charge_map_[y[i] * spacepix_columns + x[i]] = 0;
+		}
+		return clusters_;
+	}
+
+private:
+	struct Run {
+		int row;
+		int start;   // first and last column, inclusive
+		int end;
+	};
+
+	struct Sums {
+		long long q;
+		double qx;
+		double qy;
+		double x;
+		double y;
+	};
+
+	int root_of(size_t r) {
+		int i = static_cast<int>(r);
+		while (parent_[i] != i) {
+			parent_[i] = parent_[parent_[i]];   // path halving
+			i = parent_[i];
+		}
+		return i;
+	}
+
+	void unite(size_t a, size_t b) {
+		int ra = root_of(a), rb = root_of(b);
+		if (ra != rb) parent_[std::max(ra, rb)] = std::min(ra, rb);
+	}
+
+	uint64_t rows_[spacepix_rows];
+	std::vector<int> charge_map_;
+	std::vector<Run> runs_;
+	std::vector<int> parent_;
+	std::vector<int> label_;
+	std::vector<Sums> sums_;
+	std::vector<Cluster> clusters_;
+};
+
+#endif
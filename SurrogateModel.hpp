@@ -0,0 +1,384 @@
+#ifndef SPACEPIX_SURROGATE_MODEL_HPP
+#define SPACEPIX_SURROGATE_MODEL_HPP
+
+/*
+Fast surrogate of the full simulation (Geant4 + charge propagation) of
+single particles hitting the Spacepix3 sensor.
+
+The response library keeps, per particle, sensor orientation and
+simulated energy, every simulated event with hits as a template: its
+hit pixels relative to the seed pixel (the pixel with the largest
+charge), the share of the total charge on every pixel and the hit
+times. Templates are sorted by total charge, so the template index is
+the quantile of the event in the charge distribution of its energy.
+How often events leave no hits at all is kept as well.
+
+An event at energy E between two simulated energies E0 < E1 is drawn
+as follows, with w = log(E/E0) / log(E1/E0):
+- it has hits with the probability interpolated between E0 and E1,
+  which may be 0 for energies where no simulated event left charge
+- E0 and E1 are then the nearest energies that have templates
+- a template is chosen from E1 with probability w, otherwise from E0,
+  which gives the cluster shape, charge sharing and timing
+- its total charge is the charge at the same quantile, interpolated
+  linearly between the charge distributions of E0 and E1 (quantile
+  morphing), and is shared over the pixels like in the template
+Energies outside the simulated range use the nearest simulated energy.
+
+Sampling copies a few pixels per event and does not allocate once the
+event buffers have grown, so it runs at millions of events per second.
+The library is built and validated from full simulation output by
+Surrogate.C. It has no dependencies besides the standard library, the
+file is a plain binary dump in native byte order.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ClusterFinder.hpp"
+
+// Simulated events at one energy, hits of template i are
+// [offset[i], offset[i + 1])
+struct ResponseBin {
+	float energy = 0;
+	uint32_t n_events = 0;          // simulated events, with and without hits
+	std::vector<uint32_t> offset;   // one more than templates
+	std::vector<double> charge;     // total charge of each template, ascending
+	std::vector<int16_t> seed_x;    // seed pixel of each template in the simulation
+	std::vector<int16_t> seed_y;
+	std::vector<int16_t> dx;        // hit pixel relative to the seed pixel
+	std::vector<int16_t> dy;
+	std::vector<float> fraction;    // hit charge / total charge
+	std::vector<float> time;        // global_time in ns
+
+	size_t templates() const { return charge.size(); }
+	double hit_probability() const { return n_events ? static_cast<double>(templates()) / n_events : 0.; }
+};
+
+
+// All energies of one particle at one sensor orientation, ascending
+struct ResponseSet {
+	std::string particle;
+	float rotation[3] = {0, 0, 0};  // sensor x, y, z rotation in deg
+	std::vector<ResponseBin> bins;
+};
+
+
+class SurrogateLibrary {
+public:
+	std::vector<ResponseSet> sets;
+
+	const ResponseSet* find(const std::string& particle, const float rotation[3]) const {
+		for (const auto& set : sets)
+			if (set.particle == particle && std::equal(rotation, rotation + 3, set.rotation))
+				return &set;
+		return nullptr;
+	}
+
+	void write(const std::string& path) const {
+		std::ofstream out(path, std::ios::binary);
+		if (!out) throw std::runtime_error("Could not write " + path);
+		out.write(magic, sizeof(magic));
+		put(out, static_cast<uint32_t>(sets.size()));
+		for (const auto& set : sets) {
+			put(out, static_cast<uint32_t>(set.particle.size()));
+			out.write(set.particle.data(), set.particle.size());
+			out.write(reinterpret_cast<const char*>(set.rotation), sizeof(set.rotation));
+			put(out, static_cast<uint32_t>(set.bins.size()));
+			for (const auto& bin : set.bins) {
+				put(out, bin.energy);
+				put(out, bin.n_events);
+				put_vector(out, bin.offset);
+				put_vector(out, bin.charge);
+				put_vector(out, bin.seed_x);
+				put_vector(out, bin.seed_y);
+				put_vector(out, bin.dx);
+				put_vector(out, bin.dy);
+				put_vector(out, bin.fraction);
+				put_vector(out, bin.time);
+			}
+		}
+	}
+
+	static SurrogateLibrary read(const std::string& path) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) throw std::runtime_error("Could not read " + path);
+		char header[sizeof(magic)];
+		in.read(header, sizeof(header));
+		if (!in || !std::equal(header, header + sizeof(header), magic))
+			throw std::runtime_error(path + " is not a surrogate library");
+
+		SurrogateLibrary library;
+		library.sets.resize(get<uint32_t>(in));
+		for (auto& set : library.sets) {
+			set.particle.resize(get<uint32_t>(in));
+			in.read(&set.particle[0], set.particle.size());
+			in.read(reinterpret_cast<char*>(set.rotation), sizeof(set.rotation));
+			set.bins.resize(get<uint32_t>(in));
+			for (auto& bin : set.bins) {
+				bin.energy = get<float>(in);
+				bin.n_events = get<uint32_t>(in);
+				get_vector(in, bin.offset);
+				get_vector(in, bin.charge);
+				get_vector(in, bin.seed_x);
+				get_vector(in, bin.seed_y);
+				get_vector(in, bin.dx);
+				get_vector(in, bin.dy);
+				get_vector(in, bin.fraction);
+				get_vector(in, bin.time);
+			}
+		}
+		if (!in) throw std::runtime_error("Truncated surrogate library " + path);
+		return library;
+	}
+
+private:
+	static constexpr char magic[8] = {'S', 'P', 'X', 'S', 'U', 'R', 'R', '1'};
+
+	template <typename T>
+	static void put(std::ofstream& out, T value) {
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	static void put_vector(std::ofstream& out, const std::vector<T>& v) {
+		put(out, static_cast<uint64_t>(v.size()));
+		out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+	}
+
+	template <typename T>
+	static T get(std::ifstream& in) {
+		T value{};
+		in.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	static void get_vector(std::ifstream& in, std::vector<T>& v) {
+		v.resize(get<uint64_t>(in));
+		in.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(T));
+	}
+};
+
+
+// Collects simulated events into a library. Events are added one at a
+// time in any order, build() groups and sorts them.
+class SurrogateBuilder {
+public:
+	// Adds one simulated event, n = 0 for an event without hits
+	void add(const std::string& particle, const float rotation[3], float energy,
+			 const int* x, const int* y, const int* charge, const float* time, size_t n) {
+		Pending& bin = bin_for(particle, rotation, energy);
+		bin.n_events++;
+		long long total = 0;
+		size_t seed = 0;
+		for (size_t i = 0; i < n; i++) {
+			total += charge[i];
+			if (charge[i] > charge[seed]) seed = i;
+		}
+		if (n == 0 || total <= 0) return;
+
+		Pending::Event event{total, static_cast<int16_t>(x[seed]), static_cast<int16_t>(y[seed]),
+							 bin.dx.size(), n};
+		for (size_t i = 0; i < n; i++) {
+			bin.dx.push_back(static_cast<int16_t>(x[i] - x[seed]));
+			bin.dy.push_back(static_cast<int16_t>(y[i] - y[seed]));
+			bin.fraction.push_back(static_cast<float>(static_cast<double>(charge[i]) / total));
+			bin.time.push_back(time[i]);
+		}
+		bin.events.push_back(event);
+	}
+
+	SurrogateLibrary build() const {
+		SurrogateLibrary library;
+		for (const auto& key : keys_) {
+			ResponseSet* set = nullptr;
+			for (auto& s : library.sets)
+				if (s.particle == key.particle && std::equal(key.rotation, key.rotation + 3, s.rotation))
+					set = &s;
+			if (!set) {
+				library.sets.emplace_back();
+				set = &library.sets.back();
+				set->particle = key.particle;
+				std::copy(key.rotation, key.rotation + 3, set->rotation);
+			}
+			set->bins.push_back(pack(key.energy, pending_[&key - keys_.data()]));
+		}
+		for (auto& set : library.sets)
+			std::sort(set.bins.begin(), set.bins.end(),
+					  [](const ResponseBin& a, const ResponseBin& b) { return a.energy < b.energy; });
+		return library;
+	}
+
+private:
+	struct Key {
+		std::string particle;
+		float rotation[3];
+		float energy;
+	};
+
+	// Events of one bin in the order they were added
+	struct Pending {
+		struct Event {
+			long long charge;
+			int16_t seed_x, seed_y;
+			size_t first, size;
+		};
+		uint32_t n_events = 0;
+		std::vector<Event> events;
+		std::vector<int16_t> dx, dy;
+		std::vector<float> fraction, time;
+	};
+
+	std::vector<Key> keys_;
+	std::vector<Pending> pending_;
+
+	Pending& bin_for(const std::string& particle, const float rotation[3], float energy) {
+		// Consecutive events almost always share their bin
+		if (!keys_.empty()) {
+			const Key& last = keys_[last_];
+			if (last.energy == energy && last.particle == particle && std::equal(rotation, rotation + 3, last.rotation))
+				return pending_[last_];
+		}
+		for (last_ = 0; last_ < keys_.size(); last_++) {
+			const Key& key = keys_[last_];
+			if (key.energy == energy && key.particle == particle && std::equal(rotation, rotation + 3, key.rotation))
+				return pending_[last_];
+		}
+		keys_.push_back({particle, {rotation[0], rotation[1], rotation[2]}, energy});
+		pending_.emplace_back();
+		return pending_.back();
+	}
+	size_t last_ = 0;
+
+	static ResponseBin pack(float energy, const Pending& p) {
+		std::vector<size_t> order(p.events.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(),
+						 [&](size_t a, size_t b) { return p.events[a].charge < p.events[b].charge; });
+
+		ResponseBin bin;
+		bin.energy = energy;
+		bin.n_events = p.n_events;
+		bin.offset.push_back(0);
+		for (size_t i : order) {
+			const auto& event = p.events[i];
+			bin.charge.push_back(static_cast<double>(event.charge));
+			bin.seed_x.push_back(event.seed_x);
+			bin.seed_y.push_back(event.seed_y);
+			bin.dx.insert(bin.dx.end(), &p.dx[event.first], &p.dx[event.first] + event.size);
+			bin.dy.insert(bin.dy.end(), &p.dy[event.first], &p.dy[event.first] + event.size);
+			bin.fraction.insert(bin.fraction.end(), &p.fraction[event.first], &p.fraction[event.first] + event.size);
+			bin.time.insert(bin.time.end(), &p.time[event.first], &p.time[event.first] + event.size);
+			bin.offset.push_back(static_cast<uint32_t>(bin.dx.size()));
+		}
+		return bin;
+	}
+};
+
+
+// One synthetic event, hits stored like in the flux replay frames
+struct SyntheticEvent {
+	std::vector<int> x;
+	std::vector<int> y;
+	std::vector<int> charge;
+	std::vector<float> time;
+
+	size_t size() const { return x.size(); }
+	void clear() {
+		x.clear();
+		y.clear();
+		charge.clear();
+		time.clear();
+	}
+};
+
+
+class SurrogateSampler {
+public:
+	// Where the seed pixel of a synthetic event is placed
+	enum class Placement {
+		Simulated,   // where it was in the simulated event (beam spot of the simulation)
+		Uniform      // uniformly over the matrix, hits outside it are lost
+	};
+
+	explicit SurrogateSampler(const ResponseSet& set, Placement placement = Placement::Simulated)
+		: set_(set), placement_(placement) {
+		for (const auto& bin : set_.bins)
+			if (bin.templates() > 0) bins_.push_back(&bin);
+		if (bins_.empty()) throw std::runtime_error("No simulated events with hits for " + set.particle);
+	}
+
+	double min_energy() const { return bins_.front()->energy; }
+	double max_energy() const { return bins_.back()->energy; }
+
+	// Draws one event at the given energy in MeV. The event is empty if
+	// the particle leaves no charge in the sensor.
+	template <typename Rng>
+	void sample(double energy, Rng& rng, SyntheticEvent& event) const {
+		event.clear();
+		std::uniform_real_distribution<double> uniform(0., 1.);
+
+		// Bracketing energies and interpolation weight in log energy
+		auto upper = std::upper_bound(bins_.begin(), bins_.end(), energy,
+									  [](double e, const ResponseBin* bin) { return e < bin->energy; });
+		const ResponseBin* lo = upper == bins_.begin() ? bins_.front() : *(upper - 1);
+		const ResponseBin* hi = upper == bins_.end() ? bins_.back() : *upper;
+		double w = lo == hi ? 0. : std::log(energy / lo->energy) / std::log(hi->energy / lo->energy);
+
+		if (uniform(rng) >= hit_probability(energy)) return;
+
+		const ResponseBin& bin = uniform(rng) < w ? *hi : *lo;
+		size_t t = std::min(static_cast<size_t>(uniform(rng) * bin.templates()), bin.templates() - 1);
+		double quantile = (t + 0.5) / bin.templates();
+		double charge = (1 - w) * quantile_charge(*lo, quantile) + w * quantile_charge(*hi, quantile);
+
+		int seed_x = bin.seed_x[t], seed_y = bin.seed_y[t];
+		if (placement_ == Placement::Uniform) {
+			seed_x = std::uniform_int_distribution<int>(0, spacepix_columns - 1)(rng);
+			seed_y = std::uniform_int_distribution<int>(0, spacepix_rows - 1)(rng);
+		}
+		for (uint32_t h = bin.offset[t]; h < bin.offset[t + 1]; h++) {
+			int x = seed_x + bin.dx[h], y = seed_y + bin.dy[h];
+			int q = static_cast<int>(std::lround(bin.fraction[h] * charge));
+			if (x < 0 || x >= spacepix_columns || y < 0 || y >= spacepix_rows || q <= 0) continue;
+			event.x.push_back(x);
+			event.y.push_back(y);
+			event.charge.push_back(q);
+			event.time.push_back(bin.time[h]);
+		}
+	}
+
+	// Probability of an event with hits, interpolated in log energy over
+	// all simulated energies, also those where no event left charge
+	double hit_probability(double energy) const {
+		const auto& bins = set_.bins;
+		auto upper = std::upper_bound(bins.begin(), bins.end(), energy,
+									  [](double e, const ResponseBin& bin) { return e < bin.energy; });
+		if (upper == bins.begin()) return bins.front().hit_probability();
+		if (upper == bins.end()) return bins.back().hit_probability();
+		const ResponseBin& lo = *(upper - 1);
+		const ResponseBin& hi = *upper;
+		double w = std::log(energy / lo.energy) / std::log(hi.energy / lo.energy);
+		return (1 - w) * lo.hit_probability() + w * hi.hit_probability();
+	}
+
+private:
+	const ResponseSet& set_;
+	Placement placement_;
+	std::vector<const ResponseBin*> bins_;   // bins with templates, ascending energy, for the hits
+
+	static double quantile_charge(const ResponseBin& bin, double quantile) {
+		size_t i = std::min(static_cast<size_t>(quantile * bin.templates()), bin.templates() - 1);
+		return bin.charge[i];
+	}
+};
+
+#endif
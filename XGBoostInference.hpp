@@ -0,0 +1,376 @@
+#ifndef SPACEPIX_XGBOOST_INFERENCE_HPP
+#define SPACEPIX_XGBOOST_INFERENCE_HPP
+
+/*
+Native inference for the gradient boosted trees trained by
+train_classifier.py, without Python or the XGBoost library.
+
+A model is read from the JSON file XGBoost writes with
+Booster.save_model("model.json"). All trees are stored in one flat
+structure-of-arrays node table. Nodes are renumbered so that the two
+children of a node are adjacent, which turns one traversal step into
+
+    node = left[node] + (split[node] & (x[feature[node]] >= threshold[node]))
+
+without a branch. Leaves point to themselves and never step right
+(split = 0), whatever the value, +inf included, so every tree can be
+walked for the same fixed number of steps (the depth of the deepest
+tree), and a batch of events is evaluated tree by tree, keeping the
+nodes of one tree hot in cache.
+
+Only the standard library is used (the JSON reader below covers what
+the model files need), so the same header can go into the on-board
+classification path.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* ---------------- Minimal JSON reader ---------------- */
+
+struct JsonValue {
+	enum class Type { Null, Bool, Number, String, Array, Object };
+	Type type = Type::Null;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::map<std::string, JsonValue> object;
+
+	const JsonValue& operator[](const std::string& key) const {
+		auto it = object.find(key);
+		if (type != Type::Object || it == object.end())
+			throw std::runtime_error("JSON: missing key " + key);
+		return it->second;
+	}
+	bool has(const std::string& key) const { return type == Type::Object && object.count(key) > 0; }
+
+	// XGBoost writes most parameters as strings, e.g. "num_class": "3"
+	double as_number() const { return type == Type::String ? std::stod(string) : number; }
+};
+
+class JsonParser {
+public:
+	explicit JsonParser(const std::string& text) : text_(text) {}
+
+	JsonValue parse() {
+		JsonValue value = parse_value();
+		skip_space();
+		if (pos_ != text_.size()) fail("trailing characters");
+		return value;
+	}
+
+private:
+	[[noreturn]] void fail(const std::string& what) const {
+		throw std::runtime_error("JSON: " + what + " at offset " + std::to_string(pos_));
+	}
+
+	void skip_space() {
+		while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) pos_++;
+	}
+
+	char peek() {
+		skip_space();
+		if (pos_ >= text_.size()) fail("unexpected end");
+		return text_[pos_];
+	}
+
+	void expect(char c) {
+		if (peek() != c) fail(std::string("expected '") + c + "'");
+		pos_++;
+	}
+
+	JsonValue parse_value() {
+		JsonValue value;
+		char c = peek();
+		if (c == '{') {
+			value.type = JsonValue::Type::Object;
+			pos_++;
+			if (peek() == '}') { pos_++; return value; }
+			while (true) {
+				std::string key = parse_string();
+				expect(':');
+				value.object[key] = parse_value();
+				if (peek() == ',') { pos_++; continue; }
+				expect('}');
+				return value;
+			}
+		}
+		if (c == '[') {
+			value.type = JsonValue::Type::Array;
+			pos_++;
+			if (peek() == ']') { pos_++; return value; }
+			while (true) {
+				value.array.push_back(parse_value());
+				if (peek() == ',') { pos_++; continue; }
+				expect(']');
+				return value;
+			}
+		}
+		if (c == '"') {
+			value.type = JsonValue::Type::String;
+			value.string = parse_string();
+			return value;
+		}
+		if (text_.compare(pos_, 4, "true") == 0) {
+			pos_ += 4;
+			value.type = JsonValue::Type::Bool;
+			value.number = 1;
+			return value;
+		}
+		if (text_.compare(pos_, 5, "false") == 0) {
+			pos_ += 5;
+			value.type = JsonValue::Type::Bool;
+			return value;
+		}
+		if (text_.compare(pos_, 4, "null") == 0) {
+			pos_ += 4;
+			return value;
+		}
+		const char* begin = text_.c_str() + pos_;
+		char* end = nullptr;
+		value.number = std::strtod(begin, &end);
+		if (end == begin) fail("unexpected character");
+		pos_ += end - begin;
+		value.type = JsonValue::Type::Number;
+		return value;
+	}
+
+	std::string parse_string() {
+		expect('"');
+		std::string s;
+		while (pos_ < text_.size() && text_[pos_] != '"') {
+			char c = text_[pos_++];
+			if (c == '\\' && pos_ < text_.size()) {
+				char e = text_[pos_++];
+				switch (e) {
+					case 'n': s += '\n'; break;
+					case 't': s += '\t'; break;
+					case 'u': s += '?'; pos_ += 4; break;   // not used in model files
+					default: s += e;
+				}
+			} else {
+				s += c;
+			}
+		}
+		expect('"');
+		return s;
+	}
+
+	const std::string& text_;
+	size_t pos_ = 0;
+};
+
+inline JsonValue read_json(const std::string& path) {
+	std::ifstream f(path);
+	if (!f) throw std::runtime_error("Could not read " + path);
+	std::stringstream ss;
+	ss << f.rdbuf();
+	std::string text = ss.str();
+	return JsonParser(text).parse();
+}
+
+/* ---------------- Tree ensemble ---------------- */
+
+class XGBoostModel {
+public:
+	explicit XGBoostModel(const std::string& path) { load(read_json(path)); }
+
+	int num_features() const { return num_features_; }
+	int num_classes() const { return num_classes_; }
+
+	// Raw scores of n events, features row-major (n x num_features()),
+	// NaN marks a missing value. margins gets n x num_groups() values.
+	void predict_margins(const float* features, size_t n, std::vector<float>& margins) const {
+		margins.resize(n * num_groups_);
+		for (size_t e = 0; e < n; e++)
+			for (int g = 0; g < num_groups_; g++)
+				margins[e * num_groups_ + g] = base_margin_[g];
+
+		// Events are walked in blocks, tree by tree
+		constexpr size_t block = 64;
+		int32_t node[block];
+		for (size_t first = 0; first < n; first += block) {
+			size_t count = std::min(block, n - first);
+			const float* x = features + first * num_features_;
+			for (size_t t = 0; t < tree_root_.size(); t++) {
+				for (size_t e = 0; e < count; e++) node[e] = tree_root_[t];
+				for (int d = 0; d < max_depth_; d++) {
+					for (size_t e = 0; e < count; e++) {
+						int32_t i = node[e];
+						float v = x[e * num_features_ + feature_[i]];
+						bool right = (v != v) ? !default_left_[i] : !(v < threshold_[i]);
+						node[e] = left_[i] + (right & split_[i]);
+					}
+				}
+				float* m = margins.data() + first * num_groups_ + tree_group_[t];
+				for (size_t e = 0; e < count; e++)
+					m[e * num_groups_] += leaf_[node[e]];
+			}
+		}
+	}
+
+	// Predicted class index of n events
+	void predict(const float* features, size_t n, std::vector<int>& classes) const {
+		thread_local std::vector<float> margins;
+		predict_margins(features, n, margins);
+		classes.resize(n);
+		for (size_t e = 0; e < n; e++) {
+			const float* m = margins.data() + e * num_groups_;
+			if (num_groups_ == 1)
+				classes[e] = m[0] > 0 ? 1 : 0;   // binary:logistic
+			else
+				classes[e] = static_cast<int>(std::max_element(m, m + num_groups_) - m);
+		}
+	}
+
+private:
+	void load(const JsonValue& root) {
+		const JsonValue& learner = root["learner"];
+		const JsonValue& params = learner["learner_model_param"];
+		num_features_ = static_cast<int>(params["num_feature"].as_number());
+		num_classes_ = std::max(2, static_cast<int>(params["num_class"].as_number()));
+		std::string objective = learner["objective"]["name"].string;
+
+		// One group of trees (one margin) per class for softmax objectives
+		bool multiclass = objective.rfind("multi:", 0) == 0;
+		num_groups_ = multiclass ? num_classes_ : 1;
+
+		// base_score is a probability; as a margin it is the logit for
+		// binary:logistic and used unchanged for softmax. Newer XGBoost
+		// versions write it as a list, possibly one value per class.
+		std::string base = params["base_score"].string;
+		base.erase(std::remove_if(base.begin(), base.end(),
+				[](char c) { return c == '[' || c == ']'; }), base.end());
+		std::vector<float> base_scores;
+		std::stringstream bs(base);
+		std::string item;
+		while (std::getline(bs, item, ','))
+			base_scores.push_back(std::stof(item));
+		if (base_scores.empty()) base_scores.push_back(0.5f);
+		base_margin_.resize(num_groups_);
+		for (int g = 0; g < num_groups_; g++) {
+			float p = base_scores[std::min<size_t>(g, base_scores.size() - 1)];
+			base_margin_[g] = objective == "binary:logistic" ? std::log(p / (1 - p)) : p;
+		}
+
+		const JsonValue& model = learner["gradient_booster"]["model"];
+		const auto& trees = model["trees"].array;
+		const auto& tree_info = model["tree_info"].array;
+		for (size_t t = 0; t < trees.size(); t++) {
+			tree_group_.push_back(multiclass ? static_cast<int>(tree_info[t].as_number()) : 0);
+			add_tree(trees[t]);
+		}
+	}
+
+	// Appends one tree in breadth-first order, so that the children of
+	// every node are stored next to each other
+	void add_tree(const JsonValue& tree) {
+		const auto& left = tree["left_children"].array;
+		const auto& right = tree["right_children"].array;
+		const auto& split_index = tree["split_indices"].array;
+		const auto& split_condition = tree["split_conditions"].array;
+		const auto& default_left = tree["default_left"].array;
+
+		int32_t root = static_cast<int32_t>(feature_.size());
+		tree_root_.push_back(root);
+
+		// (original node, depth) in the order they are stored
+		std::vector<std::pair<int, int>> order = {{0, 0}};
+		for (size_t k = 0; k < order.size(); k++) {
+			int n = order[k].first;
+			int l = static_cast<int>(left[n].as_number());
+			if (l < 0) continue;
+			order.push_back({l, order[k].second + 1});
+			order.push_back({static_cast<int>(right[n].as_number()), order[k].second + 1});
+		}
+
+		size_t next_child = 1;
+		for (size_t k = 0; k < order.size(); k++) {
+			int n = order[k].first;
+			int32_t self = root + static_cast<int32_t>(k);
+			max_depth_ = std::max(max_depth_, order[k].second);
+			if (left[n].as_number() < 0) {
+				feature_.push_back(0);
+				threshold_.push_back(std::numeric_limits<float>::infinity());
+				default_left_.push_back(1);
+				split_.push_back(0);
+				left_.push_back(self);
+				leaf_.push_back(static_cast<float>(split_condition[n].as_number()));
+			} else {
+				int f = static_cast<int>(split_index[n].as_number());
+				if (f >= num_features_) throw std::runtime_error("Split on unknown feature");
+				feature_.push_back(f);
+				threshold_.push_back(static_cast<float>(split_condition[n].as_number()));
+				default_left_.push_back(default_left[n].as_number() != 0);
+				split_.push_back(1);
+				left_.push_back(root + static_cast<int32_t>(next_child));
+				leaf_.push_back(0.f);
+				next_child += 2;
+			}
+		}
+	}
+
+	int num_features_ = 0;
+	int num_classes_ = 0;
+	int num_groups_ = 1;
+	int max_depth_ = 0;
+	std::vector<float> base_margin_;
+	std::vector<int32_t> tree_root_;
+	std::vector<int> tree_group_;
+
+	// Node table, one entry per node of all trees
+	std::vector<int32_t> feature_;
+	std::vector<float> threshold_;
+	std::vector<uint8_t> default_left_;
+	std::vector<uint8_t> split_;     // 0 for leaves, which stay where they are
+	std::vector<int32_t> left_;      // right child is left + 1
+	std::vector<float> leaf_;
+};
+
+/* ---------------- Event classifier ---------------- */
+
+// The two models of train_classifier.py (particle type and energy bin)
+// with their label names, as exported next to the pickled model:
+//   <prefix>_type.json, <prefix>_energy.json, <prefix>_labels.json
+class EventClassifier {
+public:
+	explicit EventClassifier(const std::string& prefix)
+		: type_model_(prefix + "_type.json"), energy_model_(prefix + "_energy.json") {
+		JsonValue labels = read_json(prefix + "_labels.json");
+		for (const auto& v : labels["type"].array) type_names_.push_back(v.string);
+		for (const auto& v : labels["energy"].array) energy_names_.push_back(v.string);
+		for (const auto& v : labels["features"].array) feature_names_.push_back(v.string);
+		if (type_model_.num_features() != static_cast<int>(feature_names_.size()) ||
+		    energy_model_.num_features() != static_cast<int>(feature_names_.size()))
+			throw std::runtime_error("Models and label file disagree on the features");
+	}
+
+	size_t num_features() const { return feature_names_.size(); }
+	const std::vector<std::string>& feature_names() const { return feature_names_; }
+	const std::string& type_name(int i) const { return type_names_.at(i); }
+	const std::string& energy_name(int i) const { return energy_names_.at(i); }
+
+	void predict(const float* features, size_t n, std::vector<int>& type, std::vector<int>& energy) const {
+		type_model_.predict(features, n, type);
+		energy_model_.predict(features, n, energy);
+	}
+
+private:
+	XGBoostModel type_model_;
+	XGBoostModel energy_model_;
+	std::vector<std::string> type_names_;
+	std::vector<std::string> energy_names_;
+	std::vector<std::string> feature_names_;
+};
+
+#endif
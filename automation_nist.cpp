@@ -10,47 +10,378 @@
 #include <algorithm>
 #include <thread>
 #include <cmath>            // >>> CHANGED
+#include <chrono>
+#include <condition_variable>
+#include <atomic>
+#include <map>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <unordered_set>
+#include <memory>
+#include <functional>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
 
 namespace fs = std::filesystem;
 
 /* ---------------- Structures ---------------- */
 
 struct Task {
-    std::string main_conf_file;
-    std::string detector_conf_file;
+    std::string main_config;   // template, relative to the project root
+    // Per-run differences to the templates as allpix command line
+    // overrides: {"-o", "Module.key=value"} or {"-g", "detector.key=value"}
+    std::vector<std::pair<std::string, std::string>> overrides;
     int run_id;
+    std::string particle;
+    double energy;             // MeV
+    std::string key;           // content hash of the effective configuration
+    std::string output_name;   // data_auto_<energy>_<particle>_<orientation>.root
+    double plan_ms = 0;        // time spent building the overrides and key
+    // Chunked sweeps run a point as several runs with their own seeds;
+    // point identifies the sweep point (the key for unchunked runs)
+    std::string point;
+    int chunk = 0;
+    int events = 0;            // number_of_events of the run
+};
+
+// Where the time of one run went, see run_simulation
+struct RunProfile {
+    int run_id = 0;
+    std::string key;
+    std::string particle;
+    double energy = 0;
+    double plan_ms = 0;
+    double wall_s = 0;          // docker command, start to exit
+    double launch_s = -1;       // docker start to the first allpix log line
+    double init_s = -1;         // configuration, geometry and physics setup
+    double event_loop_s = -1;
+    double finalize_s = -1;     // end of the event loop to the last log line
+    uintmax_t output_bytes = 0;
+    bool ok = false;
 };
 
 std::mutex cout_mutex;
 
-/* ---------------- Helpers ---------------- */
+const std::string image_tag = "apsq:g4-11.3.2-root-6.32";
 
-std::string replace_parameter(const std::string& content,
-                              const std::string& param,
-                              const std::string& new_value) {
-    std::stringstream ss(content);
-    std::string line, result;
-    bool replaced = false;
+/* ---------------- Options ---------------- */
 
-    while (std::getline(ss, line)) {
-        size_t eq_pos = line.find('=');
-        if (!replaced && eq_pos != std::string::npos) {
-            std::string key = line.substr(0, eq_pos);
-            key.erase(key.find_last_not_of(" \t") + 1);
-            key.erase(0, key.find_first_not_of(" \t"));
+// PerTask starts a fresh container for every run (docker run --rm),
+// Pool keeps a fixed set of containers alive and sends runs to them
+// with docker exec, so container startup is paid once per sweep.
+enum class ExecMode { PerTask, Pool };
 
-            if (key == param) {
-                result += param + " = " + new_value + "\n";
-                replaced = true;
+struct Options {
+    ExecMode mode = ExecMode::PerTask;
+    unsigned jobs = 0;         // concurrent runs (and pool size), 0 = hardware_concurrency()
+    bool compare = false;      // run the sweep in both modes and report speedup
+    unsigned workers = 0;      // Allpix workers per run, 0 = 1 unless auto-tuned
+    bool auto_tune = false;    // pick jobs x workers from a calibration run
+    double memory_budget = 0;  // bytes usable by all runs, 0 = 90% of MemAvailable
+    int calibration_events = 100;
+    std::string sweep_file = "sweep.conf";
+    bool dry_run = false;      // plan the sweep and print it, run nothing
+    bool force = false;        // rerun tasks that are already in the run cache
+    bool legacy_merge = false; // treeMerge instead of the single-pass treeMergeStreaming
+    std::string reader_options;   // passed to treeMergeStreaming, see parseReaderOptions
+    bool pipeline = false;     // merge runs while the sweep is running
+    bool keep_cache = true;    // keep run outputs in the run cache
+    bool benchmark = false;    // run benchmark.conf from scratch and record the result
+    bool adaptive = false;     // refine the energy grids where the response changes
+};
+
+void print_usage(const char* prog) {
+    std::cout << "Usage: " << prog << " [options]\n"
+              << "  --sweep FILE           sweep description (default: sweep.conf)\n"
+              << "  --dry-run              print the planned runs and exit\n"
+              << "  --force                rerun tasks that are already in the run cache\n"
+              << "  --benchmark            run benchmark.conf from scratch and append to output/benchmark_history.csv\n"
+              << "  --adaptive             start from the grids in the sweep file and refine them where the response changes\n"
+              << "  --merge streaming|legacy  output reader (default: streaming)\n"
+              << "  --reader-options STR   options of the streaming reader, e.g. layout=both,compression=zstd:5\n"
+              << "  --pipeline             merge every run as soon as it finishes\n"
+              << "  --no-cache             with --pipeline: delete each new run once it is merged\n"
+              << "  --mode per-task|pool   container strategy (default: per-task)\n"
+              << "  --jobs N               number of concurrent runs (default: all cores)\n"
+              << "  --compare              run the sweep in both modes and report the speedup\n"
+              << "  --workers N            Allpix worker threads per run (default: 1)\n"
+              << "  --auto-tune            choose jobs and workers from a short calibration run\n"
+              << "  --memory-budget GB     memory available to all runs (default: 90% of free memory)\n"
+              << "  --calibration-events N events per calibration run (default: 100)\n";
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options opt;
+    bool sweep_given = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (arg == "--sweep") {
+            opt.sweep_file = next();
+            sweep_given = true;
+        } else if (arg == "--dry-run") {
+            opt.dry_run = true;
+        } else if (arg == "--force") {
+            opt.force = true;
+        } else if (arg == "--benchmark") {
+            opt.benchmark = true;
+        } else if (arg == "--adaptive") {
+            opt.adaptive = true;
+        } else if (arg == "--merge") {
+            std::string merge = next();
+            if (merge == "streaming")   opt.legacy_merge = false;
+            else if (merge == "legacy") opt.legacy_merge = true;
+            else throw std::runtime_error("Unknown merge mode: " + merge);
+        } else if (arg == "--reader-options") {
+            opt.reader_options = next();
+        } else if (arg == "--pipeline") {
+            opt.pipeline = true;
+        } else if (arg == "--no-cache") {
+            opt.keep_cache = false;
+        } else if (arg == "--mode") {
+            std::string mode = next();
+            if (mode == "per-task")  opt.mode = ExecMode::PerTask;
+            else if (mode == "pool") opt.mode = ExecMode::Pool;
+            else throw std::runtime_error("Unknown mode: " + mode);
+        } else if (arg == "--jobs" || arg == "-j") {
+            opt.jobs = std::stoul(next());
+            if (opt.jobs == 0)
+                throw std::runtime_error("--jobs must be at least 1");
+        } else if (arg == "--compare") {
+            opt.compare = true;
+        } else if (arg == "--workers") {
+            opt.workers = std::stoul(next());
+            if (opt.workers == 0)
+                throw std::runtime_error("--workers must be at least 1");
+        } else if (arg == "--auto-tune") {
+            opt.auto_tune = true;
+        } else if (arg == "--memory-budget") {
+            opt.memory_budget = std::stod(next()) * 1024 * 1024 * 1024;
+        } else if (arg == "--calibration-events") {
+            opt.calibration_events = std::stoi(next());
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            std::exit(0);
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+    if (opt.benchmark) {
+        // Fixed sweep, always simulated, so results are comparable
+        if (sweep_given)
+            throw std::runtime_error("--benchmark always runs benchmark.conf and cannot be combined with --sweep");
+        opt.sweep_file = "benchmark.conf";
+        opt.force = true;
+    }
+    if (opt.pipeline && (opt.legacy_merge || opt.compare))
+        throw std::runtime_error("--pipeline works with the streaming reader only and not with --compare");
+    if (opt.adaptive && (opt.pipeline || opt.compare))
+        throw std::runtime_error("--adaptive cannot be combined with --pipeline or --compare");
+    if (!opt.keep_cache && !opt.pipeline)
+        throw std::runtime_error("--no-cache needs --pipeline");
+    return opt;
+}
+
+/* ---------------- Config model ---------------- */
+
+// An Allpix-style configuration file parsed into sections and key/value
+// pairs, both in file order. Values are kept verbatim (quotes, units),
+// comments and blank lines are dropped. Keys before the first [header]
+// end up in a section with an empty name.
+struct ConfigSection {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> values;
+
+    const std::string* find(const std::string& key) const {
+        for (const auto& kv : values)
+            if (kv.first == key) return &kv.second;
+        return nullptr;
+    }
+};
+
+std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::string unquote(const std::string& s) {
+    if (s.size() >= 2 && s.front() == '"' && s.back() == '"')
+        return s.substr(1, s.size() - 2);
+    return s;
+}
+
+// Splits "a", "b, c", d on commas that are not inside quotes
+std::vector<std::string> split_list(const std::string& s) {
+    std::vector<std::string> items;
+    std::string current;
+    bool quoted = false;
+    for (char c : s) {
+        if (c == '"') quoted = !quoted;
+        if (c == ',' && !quoted) {
+            items.push_back(trim(current));
+            current.clear();
+        } else {
+            current += c;
+        }
+    }
+    if (!trim(current).empty())
+        items.push_back(trim(current));
+    return items;
+}
+
+struct ConfigFile {
+    std::vector<ConfigSection> sections;
+
+    static ConfigFile parse(const std::string& content) {
+        ConfigFile config;
+        config.sections.push_back({"", {}});
+
+        std::stringstream ss(content);
+        std::string line;
+        while (std::getline(ss, line)) {
+            // Strip comments that are not inside a quoted value
+            bool quoted = false;
+            for (size_t i = 0; i < line.size(); ++i) {
+                if (line[i] == '"') quoted = !quoted;
+                if (line[i] == '#' && !quoted) {
+                    line.erase(i);
+                    break;
+                }
+            }
+            line = trim(line);
+            if (line.empty()) continue;
+
+            if (line.front() == '[' && line.back() == ']') {
+                config.sections.push_back({trim(line.substr(1, line.size() - 2)), {}});
                 continue;
             }
+
+            size_t eq_pos = line.find('=');
+            if (eq_pos == std::string::npos)
+                throw std::runtime_error("Malformed config line: " + line);
+            config.sections.back().values.emplace_back(trim(line.substr(0, eq_pos)),
+                                                       trim(line.substr(eq_pos + 1)));
         }
-        result += line + "\n";
+        return config;
+    }
+
+    static ConfigFile read(const fs::path& path) {
+        std::ifstream f(path);
+        if (!f)
+            throw std::runtime_error("Could not read " + path.string());
+        return parse(std::string((std::istreambuf_iterator<char>(f)),
+                                 std::istreambuf_iterator<char>()));
     }
-    return result;
+
+    const ConfigSection* section(const std::string& name) const {
+        for (const auto& sec : sections)
+            if (sec.name == name) return &sec;
+        return nullptr;
+    }
+
+    std::string get(const std::string& sec, const std::string& key,
+                    const std::string& fallback = "") const {
+        const ConfigSection* s = section(sec);
+        const std::string* value = s ? s->find(key) : nullptr;
+        return value ? *value : fallback;
+    }
+
+    // Canonical text of the parsed content, independent of comments and
+    // formatting of the file it came from
+    std::string serialize() const {
+        std::string text;
+        for (const auto& sec : sections) {
+            text += "[" + sec.name + "]\n";
+            for (const auto& [key, value] : sec.values)
+                text += key + " = " + value + "\n";
+        }
+        return text;
+    }
+};
+
+// Builds an allpix command line override for a key that must already be
+// present in the template, so a renamed module or key fails at planning
+// time instead of silently running with the template value.
+std::pair<std::string, std::string> make_override(const ConfigFile& config,
+                                                  const std::string& flag,
+                                                  const std::string& section,
+                                                  const std::string& key,
+                                                  const std::string& value) {
+    const ConfigSection* s = config.section(section);
+    if (s == nullptr || s->find(key) == nullptr)
+        throw std::runtime_error("Template has no key " + key + " in [" + section + "]");
+
+    // The [Allpix] section is addressed without prefix, modules and
+    // detectors as name.key
+    std::string full_key = (section == "Allpix") ? key : section + "." + key;
+    return {flag, full_key + "=" + value};
 }
 
-/* ---------------- Logspace helper ---------------- */ //generates numbers evenly spaced on logarithmic scale
+/* ---------------- Run cache ---------------- */
+
+// Every run is stored under a key that hashes everything that determines
+// its output: the parsed templates, the per-run overrides, the seed and
+// the image tag. Outputs are written as <key>.partial.root and renamed
+// to <key>.root only on success, so anything in the cache is complete.
+const fs::path cache_dir = "output/run_cache";
+
+uint64_t fnv1a(const std::string& data, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string to_hex(uint64_t value) {
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return ss.str();
+}
+
+fs::path cache_file(const Task& task, bool partial = false) {
+    return cache_dir / (task.key + (partial ? ".partial.root" : ".root"));
+}
+
+// Every driver holds a shared lock on <cache>/.lock until it exits.
+// Sets alone if no other driver was using the cache, only then the
+// partial outputs in it are leftovers of interrupted runs and not runs
+// of another sweep that are still in progress. A driver that is alone
+// keeps the lock exclusive, so no other driver can start a run while it
+// removes them, and downgrades it with share_cache_lock afterwards.
+// Returns the lock file, -1 if it cannot be opened.
+int lock_cache(bool& alone) {
+    int fd = ::open((cache_dir / ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+    alone = fd >= 0 && ::flock(fd, LOCK_EX | LOCK_NB) == 0;
+    if (fd >= 0 && !alone)
+        ::flock(fd, LOCK_SH);   // waits for a driver that is still cleaning up
+    return fd;
+}
+
+// Kept open, released when the driver exits
+void share_cache_lock(int fd) {
+    if (fd >= 0) ::flock(fd, LOCK_SH);
+}
+
+std::string shell_quote(const std::string& s) {
+    std::string quoted = "'";
+    for (char c : s) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+/* ---------------- Energy grids ---------------- */ //generates numbers evenly spaced on logarithmic scale
 // >>> CHANGED
 std::vector<float> logspace(float start_exp, float end_exp, int num) {
     std::vector<float> values;
@@ -72,23 +403,374 @@ std::vector<float> logspace(float start_exp, float end_exp, int num) {
 }
 // <<< CHANGED
 
+std::vector<float> linspace(float start, float end, int num) {
+    std::vector<float> values;
+    values.reserve(num);
+    for (int i = 0; i < num; ++i)
+        values.push_back(num == 1 ? start : start + i * (end - start) / (num - 1));
+    return values;
+}
+
+// Parses "logspace(a, b, n)", "linspace(a, b, n)" or a plain list of
+// energies "0.1, 0.5, 2" (all in MeV)
+std::vector<float> parse_energies(const std::string& spec) {
+    size_t open = spec.find('(');
+    if (open == std::string::npos) {
+        std::vector<float> values;
+        for (const auto& item : split_list(spec))
+            values.push_back(std::stof(item));
+        return values;
+    }
+
+    std::string func = trim(spec.substr(0, open));
+    size_t close = spec.find(')', open);
+    if (close == std::string::npos)
+        throw std::runtime_error("Malformed energy grid: " + spec);
+    auto args = split_list(spec.substr(open + 1, close - open - 1));
+    if (args.size() != 3)
+        throw std::runtime_error(func + " takes three arguments: " + spec);
+
+    float a = std::stof(args[0]), b = std::stof(args[1]);
+    int n = std::stoi(args[2]);
+    if (func == "logspace") return logspace(a, b, n);
+    if (func == "linspace") return linspace(a, b, n);
+    throw std::runtime_error("Unknown energy grid function: " + func);
+}
+
+// Fixed notation with trailing zeros removed (one decimal kept), so the
+// value survives the x_y split of the output file name
+std::string format_energy(double energy) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(6) << energy;
+    std::string s = ss.str();
+    s.erase(s.find_last_not_of('0') + 1);
+    if (s.back() == '.') s += '0';
+    return s;
+}
+
+/* ---------------- Sweep planning ---------------- */
+
+// The detector the sweep rotates and whose model goes into the run keys.
+// The sweep varies a single detector, so the detectors file must have
+// exactly one section; keys before it are not a detector.
+const ConfigSection& detector_section(const ConfigFile& detector_config) {
+    const ConfigSection* detector = nullptr;
+    for (const auto& sec : detector_config.sections) {
+        if (sec.name.empty()) continue;
+        if (detector != nullptr)
+            throw std::runtime_error("Detector config has more than one detector ([" + detector->name +
+                                     "], [" + sec.name + "])");
+        detector = &sec;
+    }
+    if (detector == nullptr)
+        throw std::runtime_error("Detector config has no detector section");
+    return *detector;
+}
+
+// The sweep file lists the templates and global settings in [Sweep]
+// and one section per particle type with its energy grid. Particle
+// sections may override orientations and number_of_events.
+// With chunk_events set, every point is planned as chunks of that many
+// events, as many as chunks lists for the point (default 1).
+std::vector<Task> plan_sweep(const ConfigFile& sweep,
+                             const ConfigFile& main_config,
+                             const ConfigFile& detector_config,
+                             const std::string& detector,
+                             const std::string& main_config_path,
+                             const std::string& template_digest,
+                             const std::map<std::string, int>& chunks = {}) {
+    if (sweep.section("Sweep") == nullptr)
+        throw std::runtime_error("Sweep file has no [Sweep] section");
+
+    std::string base_seed = sweep.get("Sweep", "seed", "1");
+
+    std::vector<Task> tasks;
+    std::unordered_set<std::string> planned;
+    int run_counter = 0;
+
+    for (const auto& sec : sweep.sections) {
+        if (sec.name.empty() || sec.name == "Sweep") continue;
+        const std::string& ptype = sec.name;
+
+        auto setting = [&](const std::string& key) {
+            const std::string* value = sec.find(key);
+            return value ? *value : sweep.get("Sweep", key);
+        };
+
+        std::vector<std::string> orientations;
+        for (const auto& o : split_list(setting("orientations")))
+            orientations.push_back(unquote(o));
+        if (orientations.empty())
+            throw std::runtime_error("No orientations for " + ptype);
+        std::string n_events = setting("number_of_events");
+        std::string chunk_events = setting("chunk_events");
+        bool chunked = !chunk_events.empty();
+
+        const std::string* energies = sec.find("energies");
+        if (energies == nullptr)
+            throw std::runtime_error("No energies for " + ptype);
+
+        for (float energy : parse_energies(*energies)) {
+            std::string e_str = format_energy(energy);
+
+            std::string e_file = e_str;
+            std::replace(e_file.begin(), e_file.end(), '.', '_');
+
+            for (const auto& orient : orientations) {
+
+                std::string o_clean = orient;
+                std::replace(o_clean.begin(), o_clean.end(), ' ', '_');
+
+                std::vector<std::pair<std::string, std::string>> point_overrides = {
+                    make_override(main_config, "-o", "DepositionGeant4", "source_energy", e_str + "MeV"),
+                    make_override(main_config, "-o", "DepositionGeant4", "particle_type", "\"" + ptype + "\""),
+                    make_override(detector_config, "-g", detector, "orientation", orient),
+                };
+                std::string point_identity;
+                for (const auto& [flag, value] : point_overrides)
+                    point_identity += flag + " " + value + "\n";
+                std::string point = to_hex(fnv1a(point_identity));
+                auto n_chunks = chunks.find(point);
+                int n_runs = chunked && n_chunks != chunks.end() ? n_chunks->second : 1;
+
+                for (int chunk = 0; chunk < n_runs; ++chunk) {
+                    auto task_start = std::chrono::steady_clock::now();
+                    Task task;
+                    task.main_config = main_config_path;
+                    task.overrides = point_overrides;
+                    task.run_id = run_counter;
+                    task.particle = ptype;
+                    task.energy = std::stod(e_str);
+                    task.output_name = "data_auto_" + e_file + "_" + ptype + "_" + o_clean + ".root";
+                    std::string events = chunked ? chunk_events : n_events;
+                    if (!events.empty())
+                        task.overrides.push_back(
+                            make_override(main_config, "-o", "Allpix", "number_of_events", events));
+                    task.events = std::stoi(events.empty() ? main_config.get("Allpix", "number_of_events", "1")
+                                                           : events);
+
+                    // Seed and key depend only on what the run simulates, not on
+                    // its position in the sweep, so extending a grid keeps the
+                    // keys of existing points. Chunks differ by their index.
+                    std::string identity;
+                    for (const auto& [flag, value] : task.overrides)
+                        identity += flag + " " + value + "\n";
+                    if (chunked)
+                        identity += "chunk " + std::to_string(chunk) + "\n";
+                    uint64_t seed = fnv1a(base_seed + "\n" + identity) & 0xffffffff;
+                    task.overrides.push_back({"-o", "random_seed=" + std::to_string(seed)});
+                    task.key = to_hex(fnv1a(identity + "random_seed=" + std::to_string(seed) + "\n" + image_tag,
+                                            fnv1a(template_digest)));
+                    task.point = chunked ? point : task.key;
+                    task.chunk = chunk;
+                    if (!planned.insert(task.key).second)
+                        continue;
+
+                    // file_name is where the run is written, not what it is, so
+                    // it stays out of the key
+                    fs::path out_path = cache_file(task, true).lexically_relative("output");
+                    task.overrides.insert(task.overrides.begin(),
+                        make_override(main_config, "-o", "ROOTObjectWriter", "file_name",
+                                      "\"" + out_path.string() + "\""));
+                    task.plan_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - task_start).count();
+                    tasks.push_back(std::move(task));
+                    ++run_counter;
+                }
+            }
+        }
+    }
+    return tasks;
+}
+
+/* ---------------- Container pool ---------------- */
+
+// A set of long-lived containers that idle on `sleep infinity` and
+// receive runs through docker exec. Runs check a container out, so
+// at most one allpix process runs in each container at a time.
+struct ContainerPool {
+    std::vector<std::string> names;
+    std::vector<std::string> idle;
+    std::mutex mutex;
+    std::condition_variable available;
+
+    ContainerPool(unsigned size, const fs::path& project_root) {
+        std::string prefix = "pulse_worker_" + std::to_string(::getpid()) + "_";
+        for (unsigned i = 0; i < size; ++i)
+            names.push_back(prefix + std::to_string(i));
+
+        // Start all containers concurrently, startup latency is what
+        // the pool is meant to hide in the first place.
+        std::vector<std::future<int>> starts;
+        for (const auto& name : names) {
+            std::string command =
+            "docker run -d --rm "
+            "--name " + name + " "
+            "--user $(id -u):$(id -g) "
+            "-w /project "
+            "-v \"" + project_root.string() + ":/project\" " +
+            image_tag + " "
+            "sleep infinity > /dev/null";
+            starts.push_back(std::async(std::launch::async,
+                                        [command]() { return std::system(command.c_str()); }));
+        }
+
+        std::string failed;
+        for (size_t i = 0; i < starts.size(); ++i)
+            if (starts[i].get() != 0)
+                failed += (failed.empty() ? "" : ", ") + names[i];
+        if (!failed.empty()) {
+            shutdown();
+            throw std::runtime_error("Could not start container(s) " + failed);
+        }
+        idle = names;
+    }
+
+    ~ContainerPool() { shutdown(); }
+
+    std::string acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this]() { return !idle.empty(); });
+        std::string name = idle.back();
+        idle.pop_back();
+        return name;
+    }
+
+    void release(const std::string& name) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(name);
+        }
+        available.notify_one();
+    }
+
+    void shutdown() {
+        if (names.empty()) return;
+        std::string command = "docker rm -f";
+        for (const auto& name : names)
+            command += " " + name;
+        command += " > /dev/null 2>&1";
+        std::system(command.c_str());
+        names.clear();
+        idle.clear();
+    }
+};
+
 /* ---------------- Worker ---------------- */
 
-void run_simulation(const Task& task,
-                    const fs::path& temp_dir,
-                    const fs::path& output_dir) {
+// With more than one worker Allpix runs events on its own thread pool
+// inside the process, sharing one copy of geometry and physics tables.
+std::string allpix_command(const Task& task, unsigned workers) {
+    std::string command = "allpix -c /project/" + task.main_config;
+    for (const auto& [flag, value] : task.overrides)
+        command += " " + flag + " " + shell_quote(value);
+    if (workers > 1)
+        command += " -o multithreading=true -o workers=" + std::to_string(workers);
+    else
+        command += " -o multithreading=false";
+    return command;
+}
+
+fs::path log_file(const Task& task) {
+    return cache_dir / (task.key + ".log");
+}
+
+// Milliseconds since midnight UTC
+double utc_time_of_day_ms(std::chrono::system_clock::time_point t) {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
+    return static_cast<double>(ms % 86400000);
+}
+
+// Splits the allpix log of a run into stages. Lines of the DEFAULT log
+// format start with |HH:MM:SS.mmm| (UTC, the containers run with TZ=UTC).
+// Setup ends with "Initialized N module instantiations", the event loop
+// with "Finished run of N events"; lines without a timestamp (Geant4
+// output) are skipped.
+void parse_allpix_log(const fs::path& path, double launch_ms, RunProfile& profile) {
+    std::ifstream log(path);
+    std::string line;
+    double first = -1, last = -1, init_end = -1, loop_end = -1;
+    while (std::getline(log, line)) {
+        int h, m, sec, ms;
+        if (line.size() < 14 || line[0] != '|' ||
+            std::sscanf(line.c_str(), "|%d:%d:%d.%d|", &h, &m, &sec, &ms) != 4)
+            continue;
+        double t = ((h * 60.0 + m) * 60.0 + sec) * 1000.0 + ms;
+        // Runs across midnight
+        if (first >= 0 && t < first) t += 86400000;
+        if (first < 0) first = t;
+        last = t;
+        if (init_end < 0 && line.find("Initialized ") != std::string::npos) init_end = t;
+        if (loop_end < 0 && line.find("Finished run") != std::string::npos) loop_end = t;
+    }
+    if (first < 0) return;
+
+    double launch = first - launch_ms;
+    if (launch < -43200000) launch += 86400000;
+    profile.launch_s = launch / 1000;
+    if (init_end >= 0) profile.init_s = (init_end - first) / 1000;
+    if (init_end >= 0 && loop_end >= 0) profile.event_loop_s = (loop_end - init_end) / 1000;
+    if (loop_end >= 0) profile.finalize_s = (last - loop_end) / 1000;
+}
+
+bool run_simulation(const Task& task,
+                    unsigned workers,
+                    ContainerPool* pool,
+                    RunProfile* profile = nullptr) {
 
     fs::path project_root = fs::current_path();
+    // The log is kept next to the run for the stage timings
+    std::string command = allpix_command(task, workers) +
+                          " -l /project/" + log_file(task).string();
 
-    std::string command =
-    "docker run -it --rm "
-    "--user $(id -u):$(id -g) "
-    "-w /project "
-    "-v \"" + project_root.string() + ":/project\" "
-    "apsq:g4-11.3.2-root-6.32 "
-    "allpix -c /project/temp_configs/" + task.main_conf_file;
+    auto launch = std::chrono::system_clock::now();
+    auto start = std::chrono::steady_clock::now();
+    int return_code;
+    if (pool == nullptr) {
+        command =
+        "docker run --rm "
+        "--user $(id -u):$(id -g) "
+        "-e TZ=UTC "
+        "-w /project "
+        "-v \"" + project_root.string() + ":/project\" " +
+        image_tag + " " +
+        command;
 
-    int return_code = std::system(command.c_str());
+        return_code = std::system(command.c_str());
+    } else {
+        std::string container = pool->acquire();
+        command = "docker exec -e TZ=UTC " + container + " " + command;
+        return_code = std::system(command.c_str());
+        pool->release(container);
+    }
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+    if (return_code == 0) {
+        std::error_code ec;
+        fs::rename(cache_file(task, true), cache_file(task), ec);
+        if (ec) return_code = -1;
+    }
+    if (profile != nullptr) {
+        profile->run_id = task.run_id;
+        profile->key = task.key;
+        profile->particle = task.particle;
+        profile->energy = task.energy;
+        profile->plan_ms = task.plan_ms;
+        profile->wall_s = wall.count();
+        profile->ok = return_code == 0;
+        std::error_code ec;
+        if (return_code == 0) profile->output_bytes = fs::file_size(cache_file(task), ec);
+        parse_allpix_log(log_file(task), utc_time_of_day_ms(launch), *profile);
+    }
+
+    if (return_code == 0) {
+        // Human-readable record of what the key stands for
+        std::ofstream manifest(cache_dir / (task.key + ".conf"));
+        manifest << "# " << allpix_command(task, workers) << "\n"
+                 << "main_config = \"" << task.main_config << "\"\n"
+                 << "image = \"" << image_tag << "\"\n"
+                 << "output_name = \"" << task.output_name << "\"\n";
+    }
 
     std::lock_guard<std::mutex> lock(cout_mutex);
     if (return_code != 0) {
@@ -96,143 +778,1138 @@ void run_simulation(const Task& task,
     } else {
         std::cout << "Run " << task.run_id << " completed\n";
     }
+    return return_code == 0;
 }
 
-/* ---------------- Main ---------------- */
+/* ---------------- Process / worker tuning ---------------- */
 
-int main() {
-    fs::path temp_dir   = fs::current_path() / "temp_configs";
-    fs::path output_dir = fs::current_path() / "output";
-    fs::create_directories(temp_dir);
-    fs::create_directories(output_dir);
+// Runs a shell command and returns its standard output
+std::string run_capture(const std::string& command, int& return_code) {
+    std::string output;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        return_code = -1;
+        return output;
+    }
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+        output += buffer;
+    return_code = pclose(pipe);
+    return output;
+}
 
-    auto read_file = [](const std::string& path) {
-        std::ifstream f(path);
-        return std::string((std::istreambuf_iterator<char>(f)),
-                            std::istreambuf_iterator<char>());
-    };
+double available_memory_bytes() {
+    std::ifstream f("/proc/meminfo");
+    std::string key, unit;
+    double value;
+    while (f >> key >> value >> unit) {
+        if (key == "MemAvailable:")
+            return value * 1024;
+    }
+    return 0;
+}
 
-    std::string config_content   = read_file("spacepix3_main.conf");
-    std::string detector_content = read_file("spacepix3_detector.conf");
+struct Calibration {
+    unsigned workers;
+    double seconds;      // event loop, from the allpix log
+    double peak_bytes;   // peak memory of the container
+};
 
-    fs::path model_file = "spacepix3_model.conf";
-    fs::path model_copy = temp_dir / model_file.filename();
-    fs::copy_file(model_file, model_copy, fs::copy_options::overwrite_existing);
+// One short run of the given task in a fresh container. The container's
+// own cgroup reports the peak memory of everything that ran inside it.
+// Only the event loop is timed: at a few hundred events container start
+// and Geant4 initialization would otherwise dominate.
+Calibration calibrate(const Task& task, unsigned workers, int events) {
+    fs::path project_root = fs::current_path();
+    fs::path log = "output/calibration_" + std::to_string(workers) + ".log";
 
-    std::vector<std::string> p_types = {"proton", "e-", "alpha"};
-    std::vector<std::string> orientations = {"0deg 0deg 0deg",
-   //     "15deg 0deg 0deg",
-   //     "0deg 15deg 0deg"
-    };
+    // The task's own output file and event count are replaced, not
+    // overridden a second time on the command line
+    Task probe = task;
+    probe.overrides.erase(
+        std::remove_if(probe.overrides.begin(), probe.overrides.end(), [](const auto& o) {
+            return o.second.rfind("number_of_events=", 0) == 0 ||
+                   o.second.rfind("ROOTObjectWriter.file_name=", 0) == 0;
+        }),
+        probe.overrides.end());
+    probe.overrides.push_back({"-o", "number_of_events=" + std::to_string(events)});
+    probe.overrides.push_back({"-o", "ROOTObjectWriter.file_name=\"/tmp/calibration\""});
 
-    std::vector<Task> tasks;
-    int run_counter = 0;
+    std::string command =
+    "docker run --rm "
+    "--user $(id -u):$(id -g) "
+    "-w /project "
+    "-v \"" + project_root.string() + ":/project\" " +
+    image_tag + " "
+    "sh -c " + shell_quote(
+        allpix_command(probe, workers) +
+        " -l /project/" + log.string() + " > /dev/null 2>&1"
+        " && (cat /sys/fs/cgroup/memory.peak 2>/dev/null"
+        " || cat /sys/fs/cgroup/memory/memory.max_usage_in_bytes)");
 
-    /* -------- Energy grids -------- */
-    // >>> CHANGED
-    auto e_energies = logspace(-3, 0, 10);  // electrons
-    auto p_energies = logspace(-2, 1, 10);  // protons
-    auto a_energies = logspace(-1, 1, 10);  // alphas
-    // <<< CHANGED
+    int return_code;
+    std::string output = run_capture(command, return_code);
+    RunProfile profile;
+    parse_allpix_log(log, 0, profile);
+    fs::remove(log);
 
-    /* -------- Generate tasks and temp config files -------- */
-    // >>> CHANGED (entire loop structure)
-    for (const auto& ptype : p_types) {
+    if (return_code != 0)
+        throw std::runtime_error("Calibration run with " + std::to_string(workers) + " workers failed");
+    if (profile.event_loop_s <= 0)
+        throw std::runtime_error("No event loop in the log of the calibration run with " +
+                                 std::to_string(workers) + " workers");
 
-        const std::vector<float>* energies = nullptr;
+    // Without the peak the memory bound cannot be checked, and ignoring
+    // it is what leads to running out of memory on machines with many cores
+    double peak = 0;
+    try {
+        peak = std::stod(output);
+    } catch (const std::exception&) {
+    }
+    if (peak <= 0)
+        throw std::runtime_error("Could not read the peak memory of the calibration container");
+    return {workers, profile.event_loop_s, peak};
+}
 
-        if (ptype == "e-")       energies = &e_energies;
-        else if (ptype == "proton") energies = &p_energies;
-        else if (ptype == "alpha")  energies = &a_energies;
+struct ParallelLayout {
+    unsigned processes;
+    unsigned workers;    // Allpix workers per process
+};
 
-        for (float energy : *energies) {
+// Picks processes x workers <= cores from two calibration points. Memory
+// is modelled as linear in the number of workers (one copy of tables and
+// geometry per process plus per-worker state), throughput as the
+// single-worker rate scaled by the measured multithreading efficiency.
+// Processes beyond the number of tasks would idle, so they are not counted.
+ParallelLayout choose_layout(const Calibration& one,
+                             const Calibration& many,
+                             unsigned cores,
+                             double memory_budget,
+                             size_t n_tasks) {
+    if (memory_budget <= 0)
+        throw std::runtime_error("No memory budget, MemAvailable not readable");
+    double extra_workers = many.workers - 1.0;
+    double mem_per_worker = std::max(0.0, (many.peak_bytes - one.peak_bytes) / extra_workers);
+    double efficiency = std::clamp((one.seconds / many.seconds - 1.0) / extra_workers, 0.0, 1.0);
 
-            std::stringstream e_ss;
-            e_ss << std::fixed << std::setprecision(3) << energy;
-            std::string e_str = e_ss.str();      // e.g. 1.000e-03
+    ParallelLayout best{1, 1};
+    double best_rate = 0;
+    for (unsigned workers = 1; workers <= cores; ++workers) {
+        double mem = one.peak_bytes + mem_per_worker * (workers - 1);
+        for (unsigned processes = 1; processes * workers <= cores; ++processes) {
+            if (processes * mem > memory_budget)
+                break;
+            double active = std::min<double>(processes, n_tasks);
+            double rate = active * (1.0 + efficiency * (workers - 1));
+            if (rate > best_rate + 1e-9) {
+                best_rate = rate;
+                best = {processes, workers};
+            }
+        }
+    }
 
-            std::string e_file = e_str;
-            std::replace(e_file.begin(), e_file.end(), '.', '_');
-            std::replace(e_file.begin(), e_file.end(), '+', '_');
-            std::replace(e_file.begin(), e_file.end(), '-', 'm');
+    std::lock_guard<std::mutex> lock(cout_mutex);
+    std::cout << std::fixed << std::setprecision(2)
+              << "Calibration: " << one.peak_bytes / (1 << 20) << " MiB per process, "
+              << mem_per_worker / (1 << 20) << " MiB per extra worker, "
+              << "multithreading efficiency " << efficiency << "\n"
+              << "Using " << best.processes << " concurrent runs x "
+              << best.workers << " workers (memory budget "
+              << memory_budget / (1 << 30) << " GiB)\n" << std::defaultfloat;
+    return best;
+}
 
-            for (const auto& orient : orientations) {
+/* ---------------- Runtime model ---------------- */
 
-                std::string o_clean = orient;
-                std::replace(o_clean.begin(), o_clean.end(), ' ', '_');
+// Run time of previous runs per (particle, energy), persisted between
+// sweeps. Runs differ in their number of events and Allpix workers, so
+// an entry is core-seconds per event: wall time x workers / events.
+// Predictions interpolate linearly in log(energy) between known points
+// and clamp outside of them; particles without any history fall back to
+// a prior that grows with the deposited energy.
+struct RuntimeModel {
+    struct Entry {
+        double seconds = 0;   // per event on one worker
+        int samples = 0;
+    };
+    static constexpr const char* header = "particle,energy_MeV,seconds_per_event,samples";
+    std::map<std::string, std::map<double, Entry>> entries;
+    std::mutex mutex;
+
+    void load(const fs::path& path) {
+        std::ifstream f(path);
+        std::string line;
+        std::getline(f, line);
+        if (!line.empty() && line != header) {
+            // Written before the model was per event, its times are not comparable
+            std::cout << "Ignoring " << path.string() << " from an older version\n";
+            return;
+        }
+        while (std::getline(f, line)) {
+            std::stringstream ss(line);
+            std::string particle, energy, seconds, samples;
+            if (!std::getline(ss, particle, ',') || !std::getline(ss, energy, ',') ||
+                !std::getline(ss, seconds, ',') || !std::getline(ss, samples, ','))
+                continue;
+            // A damaged line only costs its entry, not the sweep
+            try {
+                entries[particle][std::stod(energy)] = {std::stod(seconds), std::stoi(samples)};
+            } catch (const std::exception&) {
+                std::cerr << "Skipping unreadable line in " << path.string() << ": " << line << "\n";
+            }
+        }
+    }
+
+    // Written next to the model and renamed over it, so a driver killed
+    // while saving leaves the previous model intact
+    void save(const fs::path& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fs::path temp = path.string() + ".tmp";
+        {
+            std::ofstream f(temp);
+            f << header << "\n";
+            for (const auto& [particle, by_energy] : entries)
+                for (const auto& [energy, entry] : by_energy)
+                    f << particle << "," << std::setprecision(6) << energy << ","
+                      << entry.seconds << "," << entry.samples << "\n";
+            if (!f) {
+                std::cerr << "Could not write " << temp.string() << ", runtime model not saved\n";
+                return;
+            }
+        }
+        std::error_code ec;
+        fs::rename(temp, path, ec);
+        if (ec)
+            std::cerr << "Could not replace " << path.string() << ": " << ec.message() << "\n";
+    }
 
-                std::string det_name  = "detector_auto_" + e_file + "_" + ptype + "_" + o_clean + ".conf";
-                std::string main_name = "main_auto_" + e_file + "_" + ptype + "_" + o_clean + ".conf";
+    void record(const Task& task, unsigned workers, double seconds) {
+        if (task.events <= 0) return;
+        seconds *= static_cast<double>(workers) / task.events;
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry& entry = entries[task.particle][task.energy];
+        // Running mean, so one noisy run does not reorder the next sweep
+        entry.samples += 1;
+        entry.seconds += (seconds - entry.seconds) / entry.samples;
+    }
 
-                std::string out_path =
-                    "temp_output/data_auto_" + e_file + "_" + ptype + "_" + o_clean + ".root";
+    // Expected wall time of the task with the given number of workers
+    double predict(const Task& task, unsigned workers) {
+        return per_event(task.particle, task.energy) * std::max(task.events, 1) / workers;
+    }
 
-                std::string run_det  = replace_parameter(detector_content, "orientation", orient);
-                std::string run_main = replace_parameter(config_content, "file_name", "\"" + out_path + "\"");
-                run_main = replace_parameter(run_main, "source_energy", e_str + "MeV");
-                run_main = replace_parameter(run_main, "particle_type", "\"" + ptype + "\"");
-                run_main = replace_parameter(run_main, "detectors_file", "\"" + det_name + "\"");
+    double per_event(const std::string& particle, double energy) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(particle);
+        if (it == entries.end() || it->second.empty())
+            return 1e-3 * (1.0 + energy);
 
-                std::ofstream(temp_dir / det_name)  << run_det;
-                std::ofstream(temp_dir / main_name) << run_main;
+        const auto& by_energy = it->second;
+        auto upper = by_energy.lower_bound(energy);
+        if (upper == by_energy.end())
+            return std::prev(upper)->second.seconds;
+        if (upper == by_energy.begin() || upper->first == energy)
+            return upper->second.seconds;
 
-                tasks.push_back({main_name, det_name, run_counter++});
-            }
+        auto lower = std::prev(upper);
+        double t = (std::log(energy) - std::log(lower->first)) /
+                   (std::log(upper->first) - std::log(lower->first));
+        return lower->second.seconds + t * (upper->second.seconds - lower->second.seconds);
+    }
+};
+
+/* ---------------- Sweep execution ---------------- */
+
+struct SweepStats {
+    double makespan = 0;   // wall time of the simulation phase
+    double busy = 0;       // sum of the run times of all tasks
+    double longest = 0;    // longest single run
+    int failed = 0;
+    std::vector<RunProfile> profiles;   // in completion order
+
+    // No schedule on max_parallel slots can finish before every slot has
+    // done its share of the work, nor before the longest run is done.
+    double lower_bound(unsigned max_parallel) const {
+        return std::max(busy / max_parallel, longest);
+    }
+};
+
+// Runs all tasks on max_parallel worker slots. Tasks are dispatched from
+// one ready queue ordered longest-expected-first, and every slot pulls
+// the next task as soon as its previous run finishes. on_success is
+// called from the slot for every run that completed.
+SweepStats run_sweep(const std::vector<Task>& tasks,
+                     ExecMode mode,
+                     unsigned max_parallel,
+                     unsigned workers,
+                     RuntimeModel& model,
+                     const std::function<void(const Task&)>& on_success = nullptr) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<ContainerPool> pool;
+    if (mode == ExecMode::Pool) {
+        try {
+            pool = std::make_unique<ContainerPool>(max_parallel, fs::current_path());
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << ", falling back to a container per task\n";
+            mode = ExecMode::PerTask;
         }
     }
-    // <<< CHANGED
 
-    /* -------- Parallel execution (limited) -------- */
+    std::vector<std::pair<double, const Task*>> queue;
+    queue.reserve(tasks.size());
+    for (const auto& task : tasks)
+        queue.emplace_back(model.predict(task, workers), &task);
+    std::stable_sort(queue.begin(), queue.end(),
+                     [](const auto& a, const auto& b) { return a.first > b.first; });
 
-    const unsigned max_parallel =
-        std::max(1u, std::thread::hardware_concurrency());
     std::cout << "Starting " << tasks.size()
               << " simulations with max "
-              << max_parallel << " in parallel\n";
+              << max_parallel << " in parallel"
+              << " and " << workers << " worker(s) each"
+              << (mode == ExecMode::Pool ? " (container pool)" : " (container per task)")
+              << "\n";
 
-    std::vector<std::future<void>> futures;
+    SweepStats stats;
+    std::mutex stats_mutex;
+    std::atomic<size_t> next{0};
 
-    for (const auto& task : tasks) {
-        while (futures.size() >= max_parallel) {
-            futures.front().get();
-            futures.erase(futures.begin());
+    auto worker = [&]() {
+        for (size_t i = next++; i < queue.size(); i = next++) {
+            const Task& task = *queue[i].second;
+
+            auto run_start = std::chrono::steady_clock::now();
+            RunProfile profile;
+            bool ok = run_simulation(task, workers, pool.get(), &profile);
+            std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - run_start;
+
+            if (ok) {
+                model.record(task, workers, run_time.count());
+                if (on_success) on_success(task);
+            }
+
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.busy += run_time.count();
+            stats.longest = std::max(stats.longest, run_time.count());
+            stats.failed += ok ? 0 : 1;
+            stats.profiles.push_back(profile);
+        }
+    };
+
+    std::vector<std::thread> slots;
+    for (unsigned i = 0; i < std::min<size_t>(max_parallel, tasks.size()); ++i)
+        slots.emplace_back(worker);
+    for (auto& slot : slots)
+        slot.join();
+
+    // Pool teardown is part of the cost of the mode, so stop the clock after it
+    pool.reset();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.makespan = elapsed.count();
+
+    double bound = stats.lower_bound(max_parallel);
+    std::cout << std::fixed << std::setprecision(1)
+              << "Makespan " << stats.makespan << " s, lower bound " << bound << " s ("
+              << std::setprecision(0) << 100.0 * bound / stats.makespan << "% efficient)";
+    if (stats.failed > 0)
+        std::cout << ", " << stats.failed << " runs failed";
+    std::cout << "\n" << std::defaultfloat;
+
+    return stats;
+}
+
+// One line per run of the sweep, times in seconds, -1 where the log had
+// no marker for the stage
+void write_run_profile(const fs::path& path, const std::vector<RunProfile>& profiles) {
+    std::ofstream out(path);
+    out << "run_id,key,particle,energy_mev,plan_ms,wall_s,launch_s,init_s,event_loop_s,finalize_s,output_bytes,ok\n";
+    for (const auto& p : profiles)
+        out << p.run_id << "," << p.key << "," << p.particle << "," << p.energy << ","
+            << p.plan_ms << "," << p.wall_s << "," << p.launch_s << "," << p.init_s << ","
+            << p.event_loop_s << "," << p.finalize_s << "," << p.output_bytes << "," << p.ok << "\n";
+}
+
+// Appends the stage totals of a benchmark sweep to the history file, so
+// image tags and configuration changes can be compared run against run.
+// merge_profile is the per-run file of the reader (profile= option).
+void record_benchmark(const fs::path& history,
+                      const SweepStats& stats,
+                      double merge_s,
+                      const fs::path& merge_profile,
+                      const std::string& config_digest) {
+    // Stage times are -1 where the log did not show the stage, so every
+    // stage is averaged over the runs that have it (-1 if none has)
+    struct Mean {
+        double sum = 0;
+        int n = 0;
+        void add(double v) {
+            if (v < 0) return;
+            sum += v;
+            ++n;
         }
-        futures.push_back(std::async(std::launch::async,
-                                     run_simulation,
-                                     task,
-                                     temp_dir,
-                                     output_dir));
+        double value() const { return n > 0 ? sum / n : -1; }
+    };
+    Mean launch_mean, init_mean, loop_mean;
+    double bytes = 0;
+    int n = 0;
+    for (const auto& p : stats.profiles) {
+        if (!p.ok) continue;
+        launch_mean.add(p.launch_s);
+        init_mean.add(p.init_s);
+        loop_mean.add(p.event_loop_s);
+        bytes += p.output_bytes;
+        ++n;
     }
+    if (n > 0) bytes /= n;
+    double launch = launch_mean.value(), init = init_mean.value(), loop = loop_mean.value();
 
-    for (auto& f : futures)
-        f.get();
+    // Hits and busy time of the reader over all runs
+    double hits = 0, merge_busy = 0;
+    std::ifstream in(merge_profile);
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        std::vector<std::string> cells = split_list(line);
+        if (cells.size() < 5) continue;
+        hits += std::stod(cells[3]);
+        merge_busy += std::stod(cells[4]);
+    }
 
-    // write root outputs to shared .root file with flattened tree // flattened tree can then be easily read with pythons uproot
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    bool write_header = !fs::exists(history);
+    std::ofstream out(history, std::ios::app);
+    if (write_header)
+        out << "date,image,config,runs,failed,makespan_s,mean_launch_s,mean_init_s,mean_event_loop_s,"
+               "mean_output_bytes,merge_s,merge_hits_per_s\n";
+    out << date << "," << image_tag << "," << config_digest << "," << n << "," << stats.failed << ","
+        << stats.makespan << "," << launch << "," << init << "," << loop << "," << bytes << ","
+        << merge_s << "," << (merge_busy > 0 ? hits / merge_busy : 0) << "\n";
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Benchmark (" << n << " runs): makespan " << stats.makespan << " s, per run "
+              << launch << " s container start, " << init << " s initialization, "
+              << loop << " s event loop; merge " << merge_s << " s at "
+              << std::setprecision(0) << (merge_busy > 0 ? hits / merge_busy : 0) << " hits/s\n"
+              << "Appended to " << history.string() << "\n" << std::defaultfloat;
+    if (launch_mean.n < n || init_mean.n < n || loop_mean.n < n)
+        std::cout << "Stage times found in the logs of " << launch_mean.n << " / " << init_mean.n << " / "
+                  << loop_mean.n << " of " << n << " runs\n";
+}
+
+/* ---------------- Output reading ---------------- */
+
+// Runs a command in a fresh container with the project mounted
+std::string container_command(const std::string& command) {
     fs::path project_root = fs::current_path();
-    fs::path temp_output_dir = "/project/output/temp_output";
-    std::string output_reading_command =
+    return
     "docker run --rm "
     "--user $(id -u):$(id -g) "
     "-w /project "
-    "-v \"" + project_root.string() + ":/project\" "
-    "apsq:g4-11.3.2-root-6.32 "
+    "-v \"" + project_root.string() + ":/project\" " +
+    image_tag + " " + command;
+}
+
+// Runs a function of OutputReader3.C in a fresh container
+std::string reader_command(const std::string& call) {
+    return container_command(
     "root -l -b -q "
     "-e '.L /opt/allpix/lib/libAllpixObjects.so' "
     "-e '.L OutputReader3.C++' "
-    "-e 'treeMerge(\"" + temp_output_dir.string() + "\")'";
+    "-e '" + call + "'");
+}
+
+// Merges runs while the sweep is still simulating. A long-lived reader
+// container (treeMergePipelined) polls the queue directory; every run
+// handed to submit() becomes a job file there, written under a temporary
+// name and renamed, so the reader never sees half a job. The reader
+// deletes the run file once the run is in the output, stops when it
+// finds STOP after the last job and writes DONE once the output is
+// complete. Runs it did not take, because they were unreadable or the
+// reader failed, are moved back into the cache by finish().
+class MergePipeline {
+public:
+    MergePipeline(const fs::path& queue_dir, const std::string& reader_options)
+        : queue_dir_(queue_dir) {
+        fs::remove_all(queue_dir_);
+        fs::create_directories(queue_dir_);
+        std::string command = reader_command(
+            "treeMergePipelined(\"/project/" + queue_dir_.lexically_relative(fs::current_path()).string() +
+            "\", \"" + reader_options + "\")");
+        reader_ = std::thread([this, command]() { return_code_ = std::system(command.c_str()); });
+    }
+
+    ~MergePipeline() {
+        if (reader_.joinable()) finish();
+    }
+
+    // Queues a completed run. With release_cache the run file is moved
+    // out of the cache, so it is gone once merged; its configuration and
+    // log go once the merge has succeeded. Otherwise the cache entry is
+    // linked and stays.
+    void submit(const Task& task, bool release_cache) {
+        fs::path run_file = queue_dir_ / (task.key + ".root");
+        std::error_code ec;
+        if (release_cache) {
+            fs::rename(cache_file(task), run_file, ec);
+            if (!ec) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                released_.push_back({run_file, cache_file(task), cache_dir / (task.key + ".conf"), log_file(task)});
+            }
+        } else {
+            fs::create_hard_link(cache_file(task), run_file, ec);
+            if (ec) fs::copy_file(cache_file(task), run_file, ec);
+        }
+        if (ec) {
+            std::lock_guard<std::mutex> lock(cout_mutex);
+            std::cerr << "Run " << task.run_id << " could not be queued for merging: " << ec.message() << "\n";
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ostringstream job_name;
+        job_name << std::setw(6) << std::setfill('0') << next_job_++ << ".job";
+        fs::path job = queue_dir_ / job_name.str();
+        {
+            std::ofstream out(job.string() + ".tmp");
+            out << "file = " << run_file.filename().string() << "\n"
+                << "name = " << task.output_name << "\n"
+                << "run_id = " << task.run_id << "\n";
+        }
+        fs::rename(job.string() + ".tmp", job);
+    }
+
+    // Tells the reader no more jobs will come and waits for it to write
+    // the output. Returns false if the reader failed.
+    bool finish() {
+        std::ofstream(queue_dir_ / "STOP.tmp").close();
+        fs::rename(queue_dir_ / "STOP.tmp", queue_dir_ / "STOP");
+        reader_.join();
+        bool ok = return_code_ == 0 && fs::exists(queue_dir_ / "DONE");
+
+        // Released runs still in the queue were not merged, keep them
+        bool restored = true;
+        for (const auto& run : released_) {
+            std::error_code ec;
+            if (fs::exists(run.queued)) {
+                fs::rename(run.queued, run.cached, ec);
+                if (ec) {
+                    std::cerr << "Could not move " << run.queued.string() << " back to the cache: "
+                              << ec.message() << "\n";
+                    restored = false;
+                }
+            } else if (ok) {
+                fs::remove(run.config, ec);
+                fs::remove(run.log, ec);
+            }
+        }
+        if (restored)
+            fs::remove_all(queue_dir_);
+        else
+            std::cerr << "Move the runs left in " << queue_dir_.string() << " back to " << cache_dir.string()
+                      << " before the next sweep, it clears the queue\n";
+        return ok;
+    }
+
+    int submitted() const { return next_job_; }
+
+private:
+    // A run moved out of the cache into the queue
+    struct Released {
+        fs::path queued;
+        fs::path cached;
+        fs::path config;
+        fs::path log;
+    };
+
+    fs::path queue_dir_;
+    std::thread reader_;
+    int return_code_ = 0;
+    std::mutex mutex_;
+    int next_job_ = 0;
+    std::vector<Released> released_;
+};
+
+/* ---------------- Run summaries ---------------- */
+
+// Event statistics of one or more runs, see summarizeRuns in
+// OutputReader3.C. The event charge is summed over the events with
+// hits, cluster charge and size over their clusters, so summaries add up.
+struct RunSummary {
+    double events = 0;
+    double hit_events = 0;
+    double charge = 0, charge2 = 0;
+    // Over all clusters of the events
+    double clusters = 0;
+    double cluster_charge = 0, cluster_charge2 = 0;
+    double cluster_size = 0, cluster_size2 = 0;
+
+    RunSummary& operator+=(const RunSummary& o) {
+        events += o.events;
+        hit_events += o.hit_events;
+        charge += o.charge;
+        charge2 += o.charge2;
+        clusters += o.clusters;
+        cluster_charge += o.cluster_charge;
+        cluster_charge2 += o.cluster_charge2;
+        cluster_size += o.cluster_size;
+        cluster_size2 += o.cluster_size2;
+        return *this;
+    }
+
+    static double mean(double sum, double n) { return n > 0 ? sum / n : 0; }
+
+    // Standard error of the mean from the sums
+    static double sem(double sum, double sum2, double n) {
+        if (n < 2) return 0;
+        double var = std::max(0.0, (sum2 - sum * sum / n) / (n - 1));
+        return std::sqrt(var / n);
+    }
+
+    double hit_fraction() const { return mean(hit_events, events); }
+    double hit_fraction_sem() const {
+        double p = hit_fraction();
+        return events > 0 ? std::sqrt(p * (1 - p) / events) : 0;
+    }
+};
+
+// First line of the summaries written by summarizeRuns in OutputReader3.C
+const std::string summary_header = "events,hit_events,charge_sum,charge_sum2,"
+                                   "clusters,cluster_charge_sum,cluster_charge_sum2,cluster_size_sum,cluster_size_sum2";
+
+fs::path summary_file(const Task& task) {
+    return cache_dir / (task.key + ".summary");
+}
+
+bool read_summary(const fs::path& path, RunSummary& summary) {
+    std::ifstream in(path);
+    std::string header, line;
+    if (!std::getline(in, header) || !std::getline(in, line)) return false;
+    // Summaries of older readers lack the cluster sums and are redone
+    if (header != summary_header) return false;
+    std::vector<std::string> cells = split_list(line);
+    if (cells.size() < 9) return false;
+    summary.events = std::stod(cells[0]);
+    summary.hit_events = std::stod(cells[1]);
+    summary.charge = std::stod(cells[2]);
+    summary.charge2 = std::stod(cells[3]);
+    summary.clusters = std::stod(cells[4]);
+    summary.cluster_charge = std::stod(cells[5]);
+    summary.cluster_charge2 = std::stod(cells[6]);
+    summary.cluster_size = std::stod(cells[7]);
+    summary.cluster_size2 = std::stod(cells[8]);
+    return true;
+}
+
+// Summarizes the cached runs of tasks that have no summary yet, all in
+// one reader container. Summaries are kept in the cache next to the run.
+void summarize_runs(const std::vector<Task>& tasks) {
+    fs::path list = cache_dir / "summarize.txt";
+    int missing = 0;
+    {
+        std::ofstream out(list);
+        for (const auto& task : tasks) {
+            RunSummary summary;
+            if (read_summary(summary_file(task), summary) || !fs::exists(cache_file(task))) continue;
+            out << cache_file(task).string() << "\n";
+            ++missing;
+        }
+    }
+    if (missing > 0) {
+        std::string command = reader_command("summarizeRuns(\"" + list.string() + "\")");
+        if (std::system(command.c_str()) != 0)
+            std::cerr << "Summarizing runs failed\n";
+    }
+    fs::remove(list);
+}
+
+/* ---------------- Adaptive energy grid ---------------- */
+
+// True if the detector response differs between two sweep points by
+// more than tolerance (relative for the mean cluster charge and size,
+// absolute for the fraction of events with hits) and by more than twice
+// the statistical error, so grids are not refined to chase noise.
+bool response_changes(const RunSummary& a, const RunSummary& b, double tolerance) {
+    auto differs = [&](double ma, double sa, double mb, double sb, double scale) {
+        double diff = std::abs(ma - mb);
+        return diff > tolerance * scale && diff > 2 * std::sqrt(sa * sa + sb * sb);
+    };
+    using S = RunSummary;
+    double qa = S::mean(a.cluster_charge, a.clusters), qb = S::mean(b.cluster_charge, b.clusters);
+    double na = S::mean(a.cluster_size, a.clusters), nb = S::mean(b.cluster_size, b.clusters);
+    return differs(a.hit_fraction(), a.hit_fraction_sem(), b.hit_fraction(), b.hit_fraction_sem(), 1.0) ||
+           differs(qa, S::sem(a.cluster_charge, a.cluster_charge2, a.clusters),
+                   qb, S::sem(b.cluster_charge, b.cluster_charge2, b.clusters), std::max(std::abs(qa), std::abs(qb))) ||
+           differs(na, S::sem(a.cluster_size, a.cluster_size2, a.clusters),
+                   nb, S::sem(b.cluster_size, b.cluster_size2, b.clusters), std::max(na, nb));
+}
+
+// Adds the geometric midpoint of every pair of neighbouring energies
+// whose response changes (summed over orientations), and writes the
+// energies of every particle back into sweep as an explicit list.
+// Per particle (or in [Sweep]): refine_tolerance (default 0.1),
+// refine_max_energies (default 40), refine_min_ratio (default 1.05),
+// the smallest ratio of neighbouring energies that is still bisected.
+// Returns the number of energies added.
+int refine_grid(ConfigFile& sweep, const std::vector<Task>& tasks) {
+    int added = 0;
+    for (auto& sec : sweep.sections) {
+        if (sec.name.empty() || sec.name == "Sweep") continue;
+        auto setting = [&](const std::string& key, const std::string& fallback) {
+            const std::string* value = sec.find(key);
+            return std::stod(value ? *value : sweep.get("Sweep", key, fallback));
+        };
+        double tolerance = setting("refine_tolerance", "0.1");
+        size_t max_energies = static_cast<size_t>(setting("refine_max_energies", "40"));
+        double min_ratio = setting("refine_min_ratio", "1.05");
+
+        std::map<double, RunSummary> response;
+        std::map<double, bool> complete;
+        for (const auto& task : tasks) {
+            if (task.particle != sec.name) continue;
+            RunSummary summary;
+            bool ok = read_summary(summary_file(task), summary);
+            response[task.energy] += summary;
+            complete.emplace(task.energy, true).first->second &= ok;
+        }
+
+        std::vector<double> energies;
+        for (const auto& [energy, summary] : response)
+            energies.push_back(energy);
+        std::vector<double> refined = energies;
+        for (size_t i = 0; i + 1 < energies.size() && refined.size() < max_energies; ++i) {
+            double lo = energies[i], hi = energies[i + 1];
+            if (!complete[lo] || !complete[hi] || hi / lo < min_ratio) continue;
+            if (response_changes(response[lo], response[hi], tolerance)) {
+                refined.push_back(std::sqrt(lo * hi));
+                ++added;
+            }
+        }
+        std::sort(refined.begin(), refined.end());
+
+        std::string list;
+        for (double energy : refined)
+            list += (list.empty() ? "" : ", ") + format_energy(energy);
+        bool replaced = false;
+        for (auto& [key, value] : sec.values)
+            if (key == "energies") {
+                value = list;
+                replaced = true;
+            }
+        if (!replaced) sec.values.push_back({"energies", list});
+    }
+    return added;
+}
+
+/* ---------------- Chunked runs ---------------- */
+
+// Decides how many chunks every point of a chunked sweep needs. A point
+// has converged when the relative standard errors of its mean event
+// charge and mean cluster size are both below target_precision
+// (or it has no hits at all), or when its chunks reach max_events.
+// Otherwise its chunk count is raised to what the spread so far
+// predicts for the target, by at least one chunk.
+// Settings per particle or in [Sweep]: chunk_events, target_precision
+// (default 0.02), max_events (default 20 chunks).
+// Returns the number of points that need more chunks.
+int update_chunks(const ConfigFile& sweep, const std::vector<Task>& tasks,
+                  std::map<std::string, int>& chunks) {
+    struct Point {
+        const Task* task = nullptr;
+        int runs = 0;
+        bool complete = true;
+        RunSummary summary;
+    };
+    std::map<std::string, Point> points;
+    for (const auto& task : tasks) {
+        if (task.point == task.key) continue;   // not chunked
+        Point& point = points[task.point];
+        if (!point.task) point.task = &task;
+        RunSummary summary;
+        point.complete &= read_summary(summary_file(task), summary);
+        point.summary += summary;
+        point.runs++;
+    }
+
+    int growing = 0;
+    for (const auto& [id, point] : points) {
+        // A failed chunk would be repeated with the same seed, leave the point
+        if (!point.complete) continue;
+
+        const ConfigSection* sec = sweep.section(point.task->particle);
+        auto setting = [&](const std::string& key, const std::string& fallback) {
+            const std::string* value = sec ? sec->find(key) : nullptr;
+            return std::stod(value ? *value : sweep.get("Sweep", key, fallback));
+        };
+        double chunk_events = setting("chunk_events", "100");
+        double target = setting("target_precision", "0.02");
+        int max_chunks = std::max(1, static_cast<int>(
+            std::ceil(setting("max_events", std::to_string(20 * chunk_events)) / chunk_events)));
+
+        // Precision of the mean event charge and of the mean cluster size
+        const RunSummary& s = point.summary;
+        double n = s.hit_events;
+        if (n == 0 || point.runs >= max_chunks) continue;
+        double precision = 1e300;
+        if (n >= 2 && s.clusters >= 2) {
+            double q = RunSummary::mean(s.charge, n), size = RunSummary::mean(s.cluster_size, s.clusters);
+            precision = std::max(q != 0 ? RunSummary::sem(s.charge, s.charge2, n) / std::abs(q) : 0.0,
+                                 RunSummary::sem(s.cluster_size, s.cluster_size2, s.clusters) / size);
+        }
+        if (precision <= target) continue;
+
+        // The standard error falls with the square root of the events
+        double needed = n >= 2 ? s.events * (precision / target) * (precision / target) : 2 * s.events;
+        int runs = static_cast<int>(std::ceil(needed / chunk_events));
+        chunks[id] = std::min(max_chunks, std::max(point.runs + 1, runs));
+        ++growing;
+    }
+    return growing;
+}
+
+// Combines the chunks of every chunked point into one file in the
+// staging directory with hadd, in one container. groups maps output
+// names to the cache files of their chunks.
+bool hadd_chunks(const std::map<std::string, std::vector<fs::path>>& groups,
+                 const fs::path& staging_dir) {
+    fs::path script = staging_dir / "hadd_chunks.sh";
+    {
+        std::ofstream out(script);
+        out << "set -e\n";
+        for (const auto& [name, files] : groups) {
+            out << "hadd -f " << shell_quote((staging_dir / name).lexically_relative(fs::current_path()).string());
+            for (const auto& file : files)
+                out << " " << shell_quote(file.string());
+            out << " > /dev/null\n";
+        }
+    }
+    int return_code = std::system(container_command(
+        "sh " + script.lexically_relative(fs::current_path()).string()).c_str());
+    fs::remove(script);
+    return return_code == 0;
+}
+
+/* ---------------- Main ---------------- */
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    try {
+        opt = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    fs::path output_dir = fs::current_path() / "output";
+    fs::create_directories(output_dir);
+
+    /* -------- Plan the sweep -------- */
+    // Templates are parsed once, every run only differs by its command
+    // line overrides, so nothing is written per task.
+    std::vector<Task> tasks;
+    std::string config_digest;
+    ConfigFile sweep;
+    // Plans a (refined) sweep description with the same templates
+    std::function<std::vector<Task>(const ConfigFile&, const std::map<std::string, int>&)> plan;
+    try {
+        auto plan_start = std::chrono::steady_clock::now();
+
+        sweep = ConfigFile::read(opt.sweep_file);
+        std::string main_path = unquote(sweep.get("Sweep", "main_config", "\"spacepix3_main.conf\""));
+        ConfigFile main_config = ConfigFile::read(main_path);
+        // detectors_file is relative to the main config, like allpix resolves it
+        fs::path detector_path = fs::path(main_path).parent_path() /
+                                 unquote(main_config.get("Allpix", "detectors_file"));
+        ConfigFile detector_config = ConfigFile::read(detector_path);
+        // The detector model is looked up as <type>.conf in model_paths
+        const ConfigSection& detector = detector_section(detector_config);
+        const std::string* model_type = detector.find("type");
+        if (model_type == nullptr)
+            throw std::runtime_error("Detector config has no model type");
+        fs::path model_path = fs::path(main_path).parent_path() /
+                              unquote(main_config.get("Allpix", "model_paths", "./")) /
+                              (unquote(*model_type) + ".conf");
+        ConfigFile model_config = ConfigFile::read(model_path);
 
+        std::string template_digest = main_config.serialize() + detector_config.serialize() +
+                                      model_config.serialize();
+        plan = [=, detector = detector.name](const ConfigFile& s, const std::map<std::string, int>& chunks) {
+            return plan_sweep(s, main_config, detector_config, detector, main_path, template_digest, chunks);
+        };
+        tasks = plan(sweep, {});
+        config_digest = to_hex(fnv1a(template_digest));
+
+        std::chrono::duration<double, std::milli> plan_time = std::chrono::steady_clock::now() - plan_start;
+        std::cout << "Planned " << tasks.size() << " runs from " << opt.sweep_file
+                  << " in " << std::fixed << std::setprecision(1) << plan_time.count() << " ms\n"
+                  << std::defaultfloat;
+    } catch (const std::exception& e) {
+        std::cerr << "Sweep planning failed: " << e.what() << "\n";
+        return 1;
+    }
+
+    // Points run as chunks until they converge, see update_chunks
+    bool chunked = std::any_of(tasks.begin(), tasks.end(),
+                               [](const Task& task) { return task.point != task.key; });
+    if (chunked && (opt.pipeline || opt.compare)) {
+        std::cerr << "Chunked sweeps (chunk_events) cannot be combined with --pipeline or --compare\n";
+        return 1;
+    }
+
+    if (opt.dry_run) {
+        for (const auto& task : tasks)
+            std::cout << task.run_id << ": " << allpix_command(task, 1) << "\n";
+        return 0;
+    }
+
+    /* -------- Skip runs that are already cached -------- */
+
+    fs::create_directories(cache_dir);
+    bool alone;
+    int cache_lock = lock_cache(alone);
+    if (alone) {
+        for (const auto& entry : fs::directory_iterator(cache_dir)) {
+            // Leftovers of runs that were interrupted
+            if (entry.path().string().find(".partial.") != std::string::npos)
+                fs::remove(entry.path());
+        }
+        share_cache_lock(cache_lock);
+    } else {
+        std::cout << "Another sweep is using " << cache_dir.string() << ", keeping its partial outputs\n";
+    }
+
+    std::vector<Task> pending;
+    for (const auto& task : tasks)
+        if (opt.force || opt.compare || !fs::exists(cache_file(task)))
+            pending.push_back(task);
+    std::cout << tasks.size() - pending.size() << " of " << tasks.size()
+              << " runs found in " << cache_dir.string() << ", running "
+              << pending.size() << "\n";
+
+    /* -------- Parallel execution (limited) -------- */
+
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned max_parallel = opt.jobs > 0 ? opt.jobs : cores;
+    unsigned workers = opt.workers > 0 ? opt.workers : 1;
+
+    fs::path model_path = output_dir / "runtime_model.csv";
+    RuntimeModel model;
+    model.load(model_path);
+
+    if (opt.auto_tune && !pending.empty()) {
+        // Calibrate on the run expected to be the most expensive, that is
+        // the one that sets the memory ceiling.
+        const Task* probe = &pending.front();
+        for (const auto& task : pending)
+            if (model.predict(task, 1) > model.predict(*probe, 1))
+                probe = &task;
+
+        double budget = opt.memory_budget > 0 ? opt.memory_budget : 0.9 * available_memory_bytes();
+        unsigned probe_workers = std::min(4u, cores);
+        try {
+            if (probe_workers > 1) {
+                Calibration one = calibrate(*probe, 1, opt.calibration_events);
+                Calibration many = calibrate(*probe, probe_workers, opt.calibration_events);
+                ParallelLayout layout = choose_layout(one, many, cores, budget, pending.size());
+                if (opt.jobs == 0)    max_parallel = layout.processes;
+                if (opt.workers == 0) workers = layout.workers;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Auto-tuning failed: " << e.what() << ", keeping " << max_parallel
+                      << " concurrent runs x " << workers << " workers\n";
+        }
+    }
+
+    // Per-run stage timings of the simulation and of the reader
+    fs::path run_profile_path = output_dir / "run_profile.csv";
+    fs::path merge_profile_path = output_dir / "merge_profile.csv";
+    if (opt.reader_options.find("profile=") == std::string::npos)
+        opt.reader_options += std::string(opt.reader_options.empty() ? "" : ",") + "profile=output/merge_profile.csv";
+    fs::remove(merge_profile_path);
+    SweepStats stats;
+
+    if (opt.pipeline) {
+        // Runs of earlier sweeps go to the reader right away, new runs as
+        // soon as they finish
+        MergePipeline pipeline(output_dir / "merge_queue", opt.reader_options);
+        std::unordered_set<std::string> pending_keys;
+        for (const auto& task : pending)
+            pending_keys.insert(task.key);
+        for (const auto& task : tasks)
+            if (!pending_keys.count(task.key))
+                pipeline.submit(task, false);
+
+        if (!pending.empty()) {
+            stats = run_sweep(pending, opt.mode, max_parallel, workers, model,
+                              [&](const Task& task) { pipeline.submit(task, !opt.keep_cache); });
+        }
+        model.save(model_path);
+        write_run_profile(run_profile_path, stats.profiles);
+
+        auto merge_start = std::chrono::steady_clock::now();
+        bool ok = pipeline.finish();
+        std::chrono::duration<double> tail = std::chrono::steady_clock::now() - merge_start;
+
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        if (pipeline.submitted() < static_cast<int>(tasks.size()))
+            std::cerr << tasks.size() - pipeline.submitted() << " runs have no output and are left out of the merge\n";
+        if (!ok) {
+            std::cerr << "Output reading failed.\n";
+            return 1;
+        }
+        std::cout << "Output reading succeeded, " << std::fixed << std::setprecision(1) << tail.count()
+                  << " s after the last run.\n" << std::defaultfloat;
+        if (opt.keep_cache)
+            std::cout << "Run outputs are kept in " << cache_dir.string() << ".\n";
+        if (opt.benchmark)
+            record_benchmark(output_dir / "benchmark_history.csv", stats, tail.count(),
+                             merge_profile_path, config_digest);
+        return 0;
+    }
+
+    if (opt.compare) {
+        if (pending.empty()) {
+            std::cerr << "--compare needs a sweep with at least one run\n";
+            return 1;
+        }
+        // A discarded warm-up run loads the image, the Geant4 data files
+        // and the page cache, then both modes run the same tasks in the
+        // order per task, pool, pool, per task, so neither mode always
+        // runs on the warmer machine. Every pass overwrites the cache
+        // entries of the previous one.
+        std::cout << "Running the " << pending.size() << " tasks twice per mode after a warm-up run\n";
+        run_sweep({pending.front()}, ExecMode::PerTask, 1, workers, model);
+        double t_task = 0, t_pool = 0;
+        for (ExecMode mode : {ExecMode::PerTask, ExecMode::Pool, ExecMode::Pool, ExecMode::PerTask}) {
+            double makespan = run_sweep(pending, mode, max_parallel, workers, model).makespan;
+            (mode == ExecMode::Pool ? t_pool : t_task) += makespan / 2;
+        }
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Container per task: " << t_task << " s (mean of 2 passes)\n"
+                  << "Container pool:     " << t_pool << " s (mean of 2 passes)\n"
+                  << std::setprecision(2)
+                  << "Speedup:            " << t_task / t_pool << "x over "
+                  << pending.size() << " tasks\n";
+    } else if (opt.adaptive || chunked) {
+        // Run what is planned and summarize it. Points that have not
+        // converged get more chunks; once all have, the grid is bisected
+        // where the response changes (--adaptive). Repeat with the new
+        // runs only.
+        int rounds = std::stoi(sweep.get("Sweep", "refine_rounds", "4"));
+        std::map<std::string, int> chunks;
+        for (int round = 0;;) {
+            if (!pending.empty()) {
+                SweepStats round_stats = run_sweep(pending, opt.mode, max_parallel, workers, model);
+                stats.makespan += round_stats.makespan;
+                stats.busy += round_stats.busy;
+                stats.longest = std::max(stats.longest, round_stats.longest);
+                stats.failed += round_stats.failed;
+                stats.profiles.insert(stats.profiles.end(), round_stats.profiles.begin(),
+                                      round_stats.profiles.end());
+            }
+            summarize_runs(tasks);
+
+            int growing = chunked ? update_chunks(sweep, tasks, chunks) : 0;
+            if (growing > 0) {
+                std::cout << growing << " points have not converged, running more chunks\n";
+            } else {
+                if (!opt.adaptive || round == rounds) break;
+                int added = refine_grid(sweep, tasks);
+                std::cout << "Refinement round " << ++round << ": " << added << " new energies\n";
+                if (added == 0) break;
+            }
+            tasks = plan(sweep, chunks);
+            pending.clear();
+            for (const auto& task : tasks)
+                if (!fs::exists(cache_file(task)))
+                    pending.push_back(task);
+        }
+
+        if (opt.adaptive) {
+            // The refined grid, to rerun or extend it without refinement
+            std::ofstream refined(output_dir / "refined_sweep.conf");
+            refined << "# Energy grid refined by automation_nist --adaptive from " << opt.sweep_file << "\n";
+            for (const auto& sec : sweep.sections) {
+                if (sec.name.empty()) continue;
+                refined << "\n[" << sec.name << "]\n";
+                for (const auto& [key, value] : sec.values)
+                    refined << key << " = " << value << "\n";
+            }
+            std::cout << "Adaptive sweep finished with " << tasks.size() << " runs, grid written to "
+                      << (output_dir / "refined_sweep.conf").string() << "\n";
+        }
+    } else if (!pending.empty()) {
+        stats = run_sweep(pending, opt.mode, max_parallel, workers, model);
+    }
+
+    model.save(model_path);
+    write_run_profile(run_profile_path, stats.profiles);
+
+    /* -------- Stage cached outputs for the merge -------- */
+    // The reader takes the run parameters from the file names, so the
+    // cache entries of this sweep are linked under their descriptive names.
+    // The chunks of a chunked point are combined into one file.
+    fs::path staging_dir = output_dir / "temp_output";
+    fs::remove_all(staging_dir);
+    fs::create_directories(staging_dir);
+    int missing = 0;
+    std::map<std::string, std::vector<fs::path>> runs_by_name;
+    for (const auto& task : tasks) {
+        if (!fs::exists(cache_file(task))) {
+            ++missing;
+            continue;
+        }
+        runs_by_name[task.output_name].push_back(cache_file(task));
+    }
+    std::map<std::string, std::vector<fs::path>> chunk_groups;
+    for (const auto& [name, files] : runs_by_name) {
+        if (files.size() > 1) {
+            chunk_groups[name] = files;
+            continue;
+        }
+        std::error_code ec;
+        fs::create_hard_link(files.front(), staging_dir / name, ec);
+        if (ec)
+            fs::copy_file(files.front(), staging_dir / name);
+    }
+    if (!chunk_groups.empty() && !hadd_chunks(chunk_groups, staging_dir)) {
+        // Merging without them would silently drop the chunked points
+        std::cerr << "Combining chunks failed, output reading skipped.\n";
+        fs::remove_all(staging_dir);
+        return 1;
+    }
+    if (missing > 0)
+        std::cerr << missing << " runs have no output and are left out of the merge\n";
+
+    // write root outputs to shared .root file with flattened tree // flattened tree can then be easily read with pythons uproot
+    fs::path temp_output_dir = "/project/output/temp_output";
+    std::string output_reading_command = reader_command(opt.legacy_merge
+              ? "treeMerge(\"" + temp_output_dir.string() + "\")"
+              : "treeMergeStreaming(\"" + temp_output_dir.string() + "\", \"" + opt.reader_options + "\")");
+
+    auto merge_start = std::chrono::steady_clock::now();
     int return_code = std::system(output_reading_command.c_str());
+    std::chrono::duration<double> merge_time = std::chrono::steady_clock::now() - merge_start;
 
     std::lock_guard<std::mutex> lock(cout_mutex);
+    fs::remove_all("output/temp_output");
     if (return_code != 0) {
         std::cerr << "Output reading failed.\n";
+        return 1;
     } else {
         std::cout << "Output reading succeeded.\n";
+        if (opt.benchmark)
+            record_benchmark(output_dir / "benchmark_history.csv", stats, merge_time.count(),
+                             merge_profile_path, config_digest);
     }
 
-    fs::remove_all(temp_dir);
-    fs::remove_all("output/temp_output");
-
-    std::cout << "All simulations processed. All temp folders deleted.\n";
+    std::cout << "All simulations processed. Run outputs are kept in "
+              << cache_dir.string() << ".\n";
     return 0;
 }
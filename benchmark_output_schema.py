@@ -0,0 +1,77 @@
+import os
+import sys
+import time
+import uproot
+
+# Compares the flat (one row per pixel hit) and the event layout written by
+# OutputReader3.C in size on disk and uproot load time. Write both layouts
+# into one file with
+#   treeMergeStreaming("output/temp_output", "layout=both")
+# or pass several files, e.g. written with different compression settings.
+# Directories are taken as columnar exports (reader option columnar=DIR),
+# their load time includes reading every mapped column once.
+
+FLAT_COLUMNS = ["event_idx", "pixel_x", "pixel_y", "charge", "global_time", "local_time",
+                "Incident_particle_type", "Incident_particle_energy",
+                "Sensor_x_rotation", "Sensor_y_rotation", "Sensor_z_rotation"]
+
+
+def tree_bytes(tree):
+    compressed = sum(branch.compressed_bytes for branch in tree.branches)
+    uncompressed = sum(branch.uncompressed_bytes for branch in tree.branches)
+    return compressed, uncompressed
+
+
+def time_load(load, repeat=3):
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        load()
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def benchmark(path):
+    print(f"--- {path} ---")
+    print(f"{'layout':<24}{'entries':>12}{'compressed MB':>16}{'raw MB':>10}{'load s':>10}")
+    with uproot.open(path) as file:
+        layouts = []
+        if "pixelcharge_flattened" in file:
+            flat = file["pixelcharge_flattened"]
+            layouts.append(("pixelcharge_flattened", [flat],
+                            lambda: flat.arrays(FLAT_COLUMNS, library="np")))
+        if "events" in file and "runs" in file:
+            events, runs = file["events"], file["runs"]
+            layouts.append(("events + runs", [events, runs],
+                            lambda: (events.arrays(library="ak"), runs.arrays(library="np"))))
+
+        for name, trees, load in layouts:
+            compressed = sum(tree_bytes(t)[0] for t in trees)
+            uncompressed = sum(tree_bytes(t)[1] for t in trees)
+            entries = trees[0].num_entries
+            print(f"{name:<24}{entries:>12}{compressed / 1e6:>16.2f}{uncompressed / 1e6:>10.2f}"
+                  f"{time_load(load):>10.3f}")
+
+
+def benchmark_columns(directory):
+    from columnar_hits import load_columns
+
+    def load():
+        columns = load_columns(directory)
+        for table in ("hits", "events", "runs"):
+            for values in columns[table].values():
+                values.sum()
+
+    size = sum(entry.stat().st_size for entry in os.scandir(directory) if entry.name.endswith(".bin"))
+    hits = load_columns(directory)["hits"]["charge"].shape[0]
+    print(f"--- {directory} ---")
+    print(f"{'layout':<24}{'entries':>12}{'compressed MB':>16}{'raw MB':>10}{'load s':>10}")
+    print(f"{'columnar':<24}{hits:>12}{'-':>16}{size / 1e6:>10.2f}{time_load(load):>10.3f}")
+
+
+if __name__ == "__main__":
+    for path in sys.argv[1:] or ["MergedOutput.root"]:
+        if os.path.isdir(path):
+            benchmark_columns(path)
+        else:
+            benchmark(path)
@@ -0,0 +1,223 @@
+// Microbenchmark and cross-check of ClusterFinder.hpp
+//
+//   g++ -std=c++17 -O2 cluster_benchmark.cpp -o cluster_benchmark
+//   ./cluster_benchmark [frames] [repeats]
+//
+// Generates random 64x64 frames with a mix of the topologies we expect in
+// orbit (single pixels, small charge-sharing clusters, inclined tracks,
+// pile-up of several particles per frame), checks size, charge and centroid
+// of every cluster against a plain flood fill and then reports the frame
+// rate of the finder on one core, with the machine it was measured on.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ClusterFinder.hpp"
+
+/* ---------------- Frame generation ---------------- */
+
+struct Frame {
+    std::vector<int> x, y, charge;
+};
+
+void add_hit(Frame& frame, int x, int y, int charge) {
+    if (x < 0 || x >= spacepix_columns || y < 0 || y >= spacepix_rows) return;
+    frame.x.push_back(x);
+    frame.y.push_back(y);
+    frame.charge.push_back(charge);
+}
+
+std::vector<Frame> generate_frames(size_t n, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pos(0, 63);
+    std::uniform_int_distribution<int> charge(100, 20000);
+    std::poisson_distribution<int> pileup(1.5);
+    std::uniform_int_distribution<int> kind(0, 9);
+
+    std::vector<Frame> frames(n);
+    for (auto& frame : frames) {
+        int particles = 1 + pileup(rng);
+        for (int p = 0; p < particles; p++) {
+            int x0 = pos(rng), y0 = pos(rng);
+            int k = kind(rng);
+            if (k < 4) {
+                // single pixel
+                add_hit(frame, x0, y0, charge(rng));
+            } else if (k < 8) {
+                // charge sharing over up to 2x2 pixels
+                for (int dx = 0; dx < 2; dx++)
+                    for (int dy = 0; dy < 2; dy++)
+                        if (rng() % 2 || (dx == 0 && dy == 0))
+                            add_hit(frame, x0 + dx, y0 + dy, charge(rng));
+            } else {
+                // inclined track or delta ray
+                int length = 3 + rng() % 12;
+                int sx = static_cast<int>(rng() % 3) - 1, sy = static_cast<int>(rng() % 3) - 1;
+                if (sx == 0 && sy == 0) sx = 1;
+                for (int i = 0; i < length; i++)
+                    add_hit(frame, x0 + i * sx, y0 + i * sy, charge(rng));
+            }
+        }
+    }
+    return frames;
+}
+
+/* ---------------- Reference ---------------- */
+
+struct ReferenceCluster {
+    int size;
+    long long charge;
+    double x, y;   // charge-weighted centroid
+
+    bool operator<(const ReferenceCluster& other) const {
+        if (size != other.size) return size < other.size;
+        if (charge != other.charge) return charge < other.charge;
+        if (x != other.x) return x < other.x;
+        return y < other.y;
+    }
+};
+
+// Flood fill over a dense matrix, returns the cluster sizes, charges and
+// centroids sorted, so they can be compared independent of cluster order
+std::vector<ReferenceCluster> reference_clusters(const Frame& frame) {
+    std::vector<long long> q(spacepix_columns * spacepix_rows, 0);
+    std::vector<char> hit(spacepix_columns * spacepix_rows, 0);
+    for (size_t i = 0; i < frame.x.size(); i++) {
+        q[frame.y[i] * spacepix_columns + frame.x[i]] += frame.charge[i];
+        hit[frame.y[i] * spacepix_columns + frame.x[i]] = 1;
+    }
+
+    std::vector<ReferenceCluster> result;
+    std::vector<int> stack;
+    for (int start = 0; start < spacepix_columns * spacepix_rows; start++) {
+        if (!hit[start]) continue;
+        int size = 0;
+        long long charge = 0;
+        double qx = 0, qy = 0, sx = 0, sy = 0;
+        stack.push_back(start);
+        hit[start] = 0;
+        while (!stack.empty()) {
+            int p = stack.back();
+            stack.pop_back();
+            int px = p % spacepix_columns, py = p / spacepix_columns;
+            size++;
+            charge += q[p];
+            qx += static_cast<double>(q[p]) * px;
+            qy += static_cast<double>(q[p]) * py;
+            sx += px;
+            sy += py;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int nx = px + dx, ny = py + dy;
+                    if (nx < 0 || nx >= spacepix_columns || ny < 0 || ny >= spacepix_rows) continue;
+                    int np = ny * spacepix_columns + nx;
+                    if (hit[np]) {
+                        hit[np] = 0;
+                        stack.push_back(np);
+                    }
+                }
+            }
+        }
+        if (charge > 0)
+            result.push_back({size, charge, qx / charge, qy / charge});
+        else
+            result.push_back({size, charge, sx / size, sy / size});
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Same clusters, centroids equal up to the rounding of the summation order
+bool same_clusters(const std::vector<ReferenceCluster>& a, const std::vector<ReferenceCluster>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].size != b[i].size || a[i].charge != b[i].charge) return false;
+        if (std::abs(a[i].x - b[i].x) > 1e-9 || std::abs(a[i].y - b[i].y) > 1e-9) return false;
+    }
+    return true;
+}
+
+/* ---------------- Machine ---------------- */
+
+// CPU model and compiler, to go with the measured frame rate
+std::string machine() {
+    std::string cpu = "unknown CPU";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) cpu = line.substr(line.find_first_not_of(' ', colon + 1));
+            break;
+        }
+    }
+#if defined(__clang__)
+    std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    std::string compiler = "gcc " __VERSION__;
+#else
+    std::string compiler = "unknown compiler";
+#endif
+#ifdef __OPTIMIZE__
+    compiler += ", optimized";
+#else
+    compiler += ", not optimized";
+#endif
+    return cpu + ", " + compiler;
+}
+
+/* ---------------- Main ---------------- */
+
+int main(int argc, char* argv[]) {
+    size_t n_frames = argc > 1 ? std::stoul(argv[1]) : 200000;
+    int repeats = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    std::vector<Frame> frames = generate_frames(n_frames, 42);
+    ClusterFinder finder;
+
+    // Cross-check against the flood fill
+    size_t n_hits = 0, n_clusters = 0;
+    for (const auto& frame : frames) {
+        const auto& clusters = finder.find(frame.x.data(), frame.y.data(), frame.charge.data(), frame.x.size());
+        std::vector<ReferenceCluster> found;
+        for (const auto& c : clusters)
+            found.push_back({c.size, c.charge, c.x, c.y});
+        std::sort(found.begin(), found.end());
+        if (!same_clusters(found, reference_clusters(frame))) {
+            std::cerr << "Mismatch with flood fill reference\n";
+            return 1;
+        }
+        n_hits += frame.x.size();
+        n_clusters += clusters.size();
+    }
+
+    // Timing
+    double checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (const auto& frame : frames) {
+            const auto& clusters = finder.find(frame.x.data(), frame.y.data(), frame.charge.data(), frame.x.size());
+            checksum += clusters.size();
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double processed = static_cast<double>(n_frames) * repeats;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Frames:           " << n_frames << " (" << static_cast<double>(n_hits) / n_frames
+              << " hits, " << static_cast<double>(n_clusters) / n_frames << " clusters per frame)\n"
+              << "Reference check:  passed (size, charge, centroid)\n"
+              << "Machine:          " << machine() << "\n"
+              << "Throughput:       " << processed / elapsed.count() / 1e6 << " M frames/s\n"
+              << "Time per frame:   " << elapsed.count() / processed * 1e9 << " ns\n"
+              << "(checksum " << static_cast<long long>(checksum) << ")\n";
+    return 0;
+}
@@ -0,0 +1,113 @@
+import os
+import numpy as np
+import pandas as pd
+
+# Loader of the columnar export of OutputReader3.C (reader option
+# columnar=DIR). Every column is a raw little-endian array in
+# <table>.<column>.bin, described by header.txt, so it is opened with
+# numpy.memmap: nothing is decompressed or copied until it is used, and
+# repeated loads come straight from the page cache. event_features works
+# on the mapped hit columns in their own types.
+
+
+def load_columns(directory):
+    """
+    Maps all columns of an export. Returns a dict with the tables
+    "hits", "events" and "runs" (dicts of column name -> numpy.memmap)
+    and "particle_codes" (dict of code -> particle name).
+    """
+    header_path = os.path.join(directory, "header.txt")
+    if not os.path.exists(header_path):
+        raise FileNotFoundError(f"No columnar export in {directory} (header.txt missing)")
+
+    rows, dtypes, codes = {}, [], {}
+    with open(header_path) as header:
+        for line in header:
+            fields = line.split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            if fields[0] == "format" and fields[1:] != ["spacepix-columnar", "1"]:
+                raise ValueError(f"Unsupported columnar format in {directory}")
+            if fields[0] == "byte_order" and fields[1] != "little":
+                raise ValueError(f"Unsupported byte order in {directory}")
+            if fields[0] == "particle_codes":
+                codes = {int(code): name for name, code in
+                         (item.split("=") for item in fields[1].split(","))}
+            elif fields[0] == "table":
+                rows[fields[1]] = int(fields[2])
+            elif fields[0] == "column":
+                dtypes.append(fields[1:4])
+
+    columns = {table: {} for table in rows}
+    for table, name, dtype in dtypes:
+        path = os.path.join(directory, f"{table}.{name}.bin")
+        dtype = np.dtype(dtype).newbyteorder("<")
+        if rows[table] == 0:
+            columns[table][name] = np.empty(0, dtype=dtype)
+        else:
+            columns[table][name] = np.memmap(path, dtype=dtype, mode="r", shape=(rows[table],))
+    columns["particle_codes"] = codes
+    return columns
+
+
+def event_features(columns):
+    """
+    The features train_classifier.py uses, computed per event with numpy
+    from the mapped hits, in the layout of load_event_features in
+    train_classifier.py: one row per event with hits, indexed by
+    event_id, labels as Incident_particle_type_first /
+    Incident_particle_energy_first.
+    """
+    hits, events, runs = columns["hits"], columns["events"], columns["runs"]
+    n = np.asarray(events["n_hits"], dtype=np.int64)
+    has_hits = n > 0
+    first = np.asarray(events["first_hit"], dtype=np.int64)[has_hits]
+    n = n[has_hits]
+
+    def moments(values, block=1 << 20):
+        # Sums, minima and maxima run on the mapped column in its own type
+        # (accumulating in int64). Squares need a wider type, so they are
+        # formed for a block of events at a time instead of for a copy of
+        # the whole column.
+        total = np.add.reduceat(values, first, dtype=np.int64)
+        total2 = np.empty(len(first), dtype=np.int64)
+        for start in range(0, len(first), block):
+            stop = min(start + block, len(first))
+            begin, end = first[start], first[stop - 1] + n[stop - 1]
+            chunk = values[begin:end].astype(np.int64)
+            total2[start:stop] = np.add.reduceat(chunk * chunk, first[start:stop] - begin)
+        mean = total / n
+        # Sample standard deviation, 0 for single hits like pandas std().fillna(0)
+        var = np.where(n > 1, (total2 - total * mean) / np.maximum(n - 1, 1), 0.)
+        std = np.sqrt(np.maximum(var, 0.))
+        lo = np.minimum.reduceat(values, first).astype(np.int64)
+        hi = np.maximum.reduceat(values, first).astype(np.int64)
+        return total, mean, std, lo, hi
+
+    charge_sum, charge_mean, charge_std, _, _ = moments(hits["charge"])
+    _, _, x_std, x_min, x_max = moments(hits["pixel_x"])
+    _, _, y_std, y_min, y_max = moments(hits["pixel_y"])
+
+    # Labels through the runs table
+    run_index = np.searchsorted(runs["run_id"], np.asarray(events["run_id"])[has_hits])
+    codes = columns["particle_codes"]
+    particle = np.asarray(runs["particle"])[run_index]
+    names = np.array([codes.get(c, "unknown") for c in range(256)], dtype=object)
+
+    event_df = pd.DataFrame({
+        "charge_count": n,
+        "charge_sum": charge_sum.astype(float),
+        "charge_mean": charge_mean,
+        "charge_std": charge_std,
+        "pixel_x_min": x_min,
+        "pixel_x_max": x_max,
+        "pixel_x_std": x_std,
+        "pixel_y_min": y_min,
+        "pixel_y_max": y_max,
+        "pixel_y_std": y_std,
+        "cluster_width": x_max - x_min,
+        "cluster_height": y_max - y_min,
+        "Incident_particle_type_first": names[particle],
+        "Incident_particle_energy_first": np.asarray(runs["energy"])[run_index],
+    }, index=pd.Index(np.asarray(events["event_id"])[has_hits], name="event_id"))
+    return event_df
@@ -4,6 +4,7 @@ import numpy as np
 import pickle
 import os
 from sklearn.metrics import accuracy_score, classification_report
+from train_classifier import load_event_features
 
 def test_on_new_data(test_root_file, tree_name, model_folder, event_count_tag):
     # 1. LOAD MODEL AND ENCODERS
@@ -26,21 +27,27 @@ def test_on_new_data(test_root_file, tree_name, model_folder, event_count_tag):
     # 2. LOAD AND AGGREGATE TEST DATA
     print(f"Loading test data: {test_root_file}")
     with uproot.open(test_root_file) as file:
-        df = file[tree_name].arrays(library="pd")
-    
-    agg_logic = {
-        'charge': ['sum', 'mean', 'count', 'std'],
-        'pixel_x': ['min', 'max', 'std'],
-        'pixel_y': ['min', 'max', 'std'],
-        'Incident_particle_type': 'first',
-        'Incident_particle_energy': 'first'
-    }
-    
-    event_df = df.groupby('event_idx').agg(agg_logic)
-    event_df.columns = [f"{col[0]}_{col[1]}" for col in event_df.columns]
-    event_df = event_df.fillna(0)
-    event_df['cluster_width'] = event_df['pixel_x_max'] - event_df['pixel_x_min']
-    event_df['cluster_height'] = event_df['pixel_y_max'] - event_df['pixel_y_min']
+        has_features = "event_features" in file
+
+    if has_features:
+        event_df = load_event_features(test_root_file)
+    else:
+        with uproot.open(test_root_file) as file:
+            df = file[tree_name].arrays(library="pd")
+        
+        agg_logic = {
+            'charge': ['sum', 'mean', 'count', 'std'],
+            'pixel_x': ['min', 'max', 'std'],
+            'pixel_y': ['min', 'max', 'std'],
+            'Incident_particle_type': 'first',
+            'Incident_particle_energy': 'first'
+        }
+        
+        event_df = df.groupby('event_idx').agg(agg_logic)
+        event_df.columns = [f"{col[0]}_{col[1]}" for col in event_df.columns]
+        event_df = event_df.fillna(0)
+        event_df['cluster_width'] = event_df['pixel_x_max'] - event_df['pixel_x_min']
+        event_df['cluster_height'] = event_df['pixel_y_max'] - event_df['pixel_y_min']
 
     # 3. PREPROCESSING
     features = ['charge_sum', 'charge_mean', 'charge_count', 'charge_std', 
@@ -3,41 +3,92 @@ import pandas as pd
 import numpy as np
 import xgboost as xgb
 import pickle
+import json
 import os
 from tqdm import tqdm
 from sklearn.model_selection import train_test_split
 from sklearn.metrics import accuracy_score, classification_report, confusion_matrix
 from sklearn.preprocessing import LabelEncoder
 from sklearn.multioutput import MultiOutputClassifier
+from columnar_hits import load_columns, event_features
 
-def run_ml_pipeline_root(root_file, tree_name):
-    # --- 1. DATA LOADING ---
-    print(f"Opening ROOT file: {root_file}")
+def load_event_features(root_file):
+    """
+    Reads the event_features tree written by OutputReader3.C
+    (reader option "features"). Returns one row per event with the
+    feature columns and the labels as Incident_particle_type_first /
+    Incident_particle_energy_first, like the pandas aggregation below.
+    Events without hits are dropped, they never appear in the flat tree.
+    """
     with uproot.open(root_file) as file:
-        tree = file[tree_name]
-        columns = ["event_idx", "pixel_x", "pixel_y", "charge", 
-                   "Incident_particle_type", "Incident_particle_energy"]
-        df = tree.arrays(columns, library="pd")
-    
-    print(f"Loaded {len(df)} raw pixel hits.")
-
-    # --- 2. EVENT AGGREGATION ---
-    agg_logic = {
-        'charge': ['sum', 'mean', 'count', 'std'],
-        'pixel_x': ['min', 'max', 'std'],
-        'pixel_y': ['min', 'max', 'std'],
-        'Incident_particle_type': 'first',
-        'Incident_particle_energy': 'first'
-    }
-    
-    event_df = df.groupby('event_idx').agg(agg_logic)
-    event_df.columns = [f"{col[0]}_{col[1]}" for col in event_df.columns]
-    event_df = event_df.fillna(0)
+        event_df = file["event_features"].arrays(library="pd")
+        codes = dict(item.split("=")[::-1] for item in
+                     file["particle_codes"].member("fTitle").split(","))
+
+    event_df = event_df[event_df["charge_count"] > 0].set_index("event_id")
+    event_df["Incident_particle_type_first"] = event_df["particle"].astype(str).map(codes)
+    event_df["Incident_particle_energy_first"] = event_df["energy"]
+    return event_df
+
+
+def run_ml_pipeline_root(root_file, tree_name, columns_dir=None):
+    # --- 1. DATA LOADING ---
+    header = os.path.join(columns_dir, "header.txt") if columns_dir is not None else None
+    use_columns = header is not None and os.path.exists(header)
+    if use_columns and os.path.exists(root_file) and os.path.getmtime(header) < os.path.getmtime(root_file):
+        # The export is written after the ROOT file, so it is from an older merge
+        print(f"Ignoring columnar export {columns_dir}, it is older than {root_file}")
+        use_columns = False
+    if use_columns:
+        print(f"Reading columnar export: {columns_dir}")
+    else:
+        print(f"Opening ROOT file: {root_file}")
+        with uproot.open(root_file) as file:
+            has_features = "event_features" in file
 
-    # Feature Engineering
-    event_df['cluster_width'] = event_df['pixel_x_max'] - event_df['pixel_x_min']
-    event_df['cluster_height'] = event_df['pixel_y_max'] - event_df['pixel_y_min']
+    if use_columns:
+        # Hits are memory mapped (reader option columnar=DIR), the
+        # features are computed with numpy without a DataFrame of hits
+        event_df = event_features(load_columns(columns_dir))
+    elif has_features:
+        # Features were computed per event by the reader, no need to load the hits
+        event_df = load_event_features(root_file)
+    else:
+        with uproot.open(root_file) as file:
+            tree = file[tree_name]
+            columns = ["event_idx", "pixel_x", "pixel_y", "charge", 
+                       "Incident_particle_type", "Incident_particle_energy",
+                       "Sensor_x_rotation", "Sensor_y_rotation", "Sensor_z_rotation"]
+            df = tree.arrays(columns, library="pd")
+        
+        print(f"Loaded {len(df)} raw pixel hits.")
+
+        # --- 2. EVENT AGGREGATION ---
+        agg_logic = {
+            'charge': ['sum', 'mean', 'count', 'std'],
+            'pixel_x': ['min', 'max', 'std'],
+            'pixel_y': ['min', 'max', 'std'],
+            'Incident_particle_type': 'first',
+            'Incident_particle_energy': 'first'
+        }
+        
+        # event_idx restarts with every run, so an event is a block of
+        # consecutive hits with the same event_idx and run parameters
+        event_keys = ["event_idx", "Incident_particle_type", "Incident_particle_energy",
+                      "Sensor_x_rotation", "Sensor_y_rotation", "Sensor_z_rotation"]
+        df["event"] = (df[event_keys] != df[event_keys].shift()).any(axis=1).cumsum()
+        event_df = df.groupby('event').agg(agg_logic)
+        event_df.columns = [f"{col[0]}_{col[1]}" for col in event_df.columns]
+        event_df = event_df.fillna(0)
+
+        # Feature Engineering
+        event_df['cluster_width'] = event_df['pixel_x_max'] - event_df['pixel_x_min']
+        event_df['cluster_height'] = event_df['pixel_y_max'] - event_df['pixel_y_min']
     
+    # Same order, and so the same split, whatever layout or reader
+    # thread order the events came in
+    event_df = event_df.sort_index()
+
     num_events = len(event_df)
     print(f"Aggregated into {num_events} unique particle events.")
 
@@ -100,11 +151,28 @@ def run_ml_pipeline_root(root_file, tree_name):
     with open(encoder_path, "wb") as f:
         pickle.dump({'type': le_type, 'energy': le_energy}, f)
         
+    # Export for the native inference library (XGBoostInference.hpp):
+    # both boosters as JSON, the label names, and the test split with the
+    # predictions of this model so xgb_benchmark can check it agrees
+    export_prefix = os.path.join(save_folder, f"event_model_{num_events}events")
+    for estimator, name in zip(model.estimators_, ["type", "energy"]):
+        estimator.get_booster().save_model(f"{export_prefix}_{name}.json")
+    with open(f"{export_prefix}_labels.json", "w") as f:
+        json.dump({'features': features,
+                   'type': [str(c) for c in le_type.classes_],
+                   'energy': [str(c) for c in le_energy.classes_]}, f)
+    test_df = pd.DataFrame(X_test.astype(np.float32), columns=features)
+    test_df['pred_type'] = pred_type
+    test_df['pred_energy'] = pred_energy
+    test_df.to_csv(f"{export_prefix}_test.csv", index=False, float_format="%.9g")
+
     print(f"\nSUCCESS: Files saved in '{save_folder}/'")
     print(f"Saved: {model_filename}")
     print(f"Saved: {encoder_filename}")
+    print(f"Saved: {os.path.basename(export_prefix)}_{{type,energy,labels}}.json, _test.csv")
 
 if __name__ == "__main__":
     FILE_PATH = "MergedOutput.root"
     TREE_PATH = "pixelcharge_flattened"
-    run_ml_pipeline_root(FILE_PATH, TREE_PATH)
\ No newline at end of file
+    COLUMNS_PATH = "MergedColumns"
+    run_ml_pipeline_root(FILE_PATH, TREE_PATH, COLUMNS_PATH)
\ No newline at end of file
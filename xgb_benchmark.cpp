@@ -0,0 +1,145 @@
+// Validation and benchmark of XGBoostInference.hpp
+//
+//   g++ -std=c++17 -O2 -march=native xgb_benchmark.cpp -o xgb_benchmark
+//   ./xgb_benchmark trained_models_for_classification/event_model_<N>events [batch] [seconds]
+//
+// train_classifier.py exports next to the pickled model the two boosters
+// (<prefix>_type.json, <prefix>_energy.json), the label names
+// (<prefix>_labels.json) and the test split of MergedOutput.root with the
+// predictions of the Python model (<prefix>_test.csv). Every test event is
+// classified again here and compared with the Python prediction, then the
+// batch throughput and the latency of single events are measured.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "XGBoostInference.hpp"
+
+/* ---------------- Test split ---------------- */
+
+struct TestSplit {
+    std::vector<float> features;   // row-major, columns in model order
+    std::vector<int> type;         // Python predictions
+    std::vector<int> energy;
+    size_t size = 0;
+};
+
+TestSplit read_test_split(const std::string& path, const std::vector<std::string>& feature_names) {
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error("Could not read " + path);
+
+    auto split = [](const std::string& line) {
+        std::vector<std::string> cells;
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, ','))
+            cells.push_back(cell);
+        return cells;
+    };
+
+    std::string line;
+    std::getline(f, line);
+    std::vector<std::string> header = split(line);
+    auto column = [&](const std::string& name) {
+        auto it = std::find(header.begin(), header.end(), name);
+        if (it == header.end()) throw std::runtime_error("Column " + name + " missing in " + path);
+        return static_cast<size_t>(it - header.begin());
+    };
+    std::vector<size_t> feature_columns;
+    for (const auto& name : feature_names)
+        feature_columns.push_back(column(name));
+    size_t type_column = column("pred_type");
+    size_t energy_column = column("pred_energy");
+
+    TestSplit test;
+    while (std::getline(f, line)) {
+        if (line.empty()) continue;
+        std::vector<std::string> cells = split(line);
+        for (size_t c : feature_columns)
+            test.features.push_back(cells.at(c).empty() ? NAN : std::stof(cells.at(c)));
+        test.type.push_back(std::stoi(cells.at(type_column)));
+        test.energy.push_back(std::stoi(cells.at(energy_column)));
+        test.size++;
+    }
+    return test;
+}
+
+/* ---------------- Main ---------------- */
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <model prefix> [batch] [seconds]\n";
+        return 1;
+    }
+    std::string prefix = argv[1];
+    size_t batch = argc > 2 ? std::stoul(argv[2]) : 256;
+    double seconds = argc > 3 ? std::stod(argv[3]) : 2.;
+
+    EventClassifier classifier(prefix);
+    TestSplit test = read_test_split(prefix + "_test.csv", classifier.feature_names());
+    if (test.size == 0) {
+        std::cerr << "Empty test split\n";
+        return 1;
+    }
+    size_t n_features = classifier.num_features();
+
+    // Compare with the Python predictions
+    std::vector<int> type, energy;
+    classifier.predict(test.features.data(), test.size, type, energy);
+    size_t type_mismatch = 0, energy_mismatch = 0;
+    for (size_t e = 0; e < test.size; e++) {
+        type_mismatch += type[e] != test.type[e];
+        energy_mismatch += energy[e] != test.energy[e];
+    }
+
+    // Batch throughput, cycling through the test split
+    std::vector<float> input(batch * n_features);
+    for (size_t i = 0; i < batch; i++)
+        std::copy_n(&test.features[(i % test.size) * n_features], n_features, &input[i * n_features]);
+    size_t processed = 0;
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+    while (elapsed.count() < seconds) {
+        classifier.predict(input.data(), batch, type, energy);
+        checksum += type[0] + energy[batch - 1];
+        processed += batch;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    // Latency of single events, as in the real-time path
+    std::vector<double> latency;
+    for (int r = 0; latency.size() < 100000 && r < 1000; r++) {
+        for (size_t e = 0; e < test.size && latency.size() < 100000; e++) {
+            auto t0 = std::chrono::steady_clock::now();
+            classifier.predict(&test.features[e * n_features], 1, type, energy);
+            auto t1 = std::chrono::steady_clock::now();
+            checksum += type[0];
+            latency.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        }
+    }
+    std::sort(latency.begin(), latency.end());
+    auto percentile = [&](double p) { return latency[static_cast<size_t>(p * (latency.size() - 1))]; };
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "Test events:      " << test.size << "\n"
+              << "Type mismatches:  " << type_mismatch << "\n"
+              << "Energy mismatches: " << energy_mismatch << "\n"
+              << "Throughput:       " << processed / elapsed.count() / 1e6 << " M events/s (batch " << batch << ")\n"
+              << "Latency p50:      " << percentile(0.50) << " us\n"
+              << "Latency p99:      " << percentile(0.99) << " us\n"
+              << "(checksum " << checksum << ")\n";
+
+    if (type_mismatch || energy_mismatch) {
+        std::cerr << "Predictions differ from the Python model\n";
+        return 1;
+    }
+    return 0;
+}